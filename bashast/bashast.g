@@ -132,6 +132,24 @@ tokens{
 	BUILTIN_LOGIC_OR;
 
 	FUNCTION;
+	LAZY_FUNCTION_BODY;
+}
+
+@parser::context
+{
+#ifdef OUTPUT_C
+	// Function bodies are not parsed when this is true
+	bool lazy_function_bodies;
+	ANTLR3_MARKER lazy_function_body_end;
+#endif
+}
+
+@parser::apifuncs
+{
+#ifdef OUTPUT_C
+	ctx->lazy_function_bodies = false;
+	ctx->lazy_function_body_end = 0;
+#endif
 }
 
 @lexer::context
@@ -168,6 +186,7 @@ tokens{
 @postinclude {
 	C_INCLUDE #include <boost/numeric/conversion/cast.hpp>
 
+	C_INCLUDE #include "core/function_body_scanner.h"
 	C_INCLUDE #include "exceptions.h"
 }
 @lexer::postinclude {
@@ -201,6 +220,15 @@ tokens{
 	{
 		(&(scope->here_document_word))->std::string::~string();
 	}
+
+	// Find the right brace that ends the function body starting at LT(1).
+	// The scanner works on the script because the input is in place.
+	static bool find_lazy_function_body_end(plibbashParser ctx)
+	{
+		const char* end = find_function_body_end(reinterpret_cast<const char*>(LT(1)->start));
+		ctx->lazy_function_body_end = reinterpret_cast<ANTLR3_MARKER>(end);
+		return end != 0;
+	}
 #else
 	boolean is_here_end(String here_document_word, int number_of_tokens) {
 		String word = "";
@@ -387,8 +415,8 @@ command_atom
 		(LA(1) == NAME && LA(2) == BLANK && "test".equals(get_string(LT(1))))}? => compound_command
 	|	{LA(1) == NAME && LA(2) == BLANK && "function".equals(get_string(LT(1)))}? =>
 #endif
-			NAME BLANK string_expr_no_reserved_word ((BLANK? parens wspace?)|wspace) compound_command
-			-> ^(FUNCTION string_expr_no_reserved_word compound_command)
+			NAME BLANK string_expr_no_reserved_word ((BLANK? parens wspace?)|wspace) function_body
+			-> ^(FUNCTION string_expr_no_reserved_word function_body)
 	|	(name (LSQUARE|EQUALS|PLUS EQUALS)) => variable_definitions
 			(
 				(BLANK bash_command) => BLANK bash_command -> bash_command variable_definitions
@@ -402,8 +430,8 @@ command_atom
 			-> ^(STRING DECLARE) ^(STRING builtin_variable_definition_item)
 	|	command_name
 		(
-			(BLANK? parens) => BLANK? parens wspace? compound_command
-				-> ^(FUNCTION command_name compound_command)
+			(BLANK? parens) => BLANK? parens wspace? function_body
+				-> ^(FUNCTION command_name function_body)
 			|	(
 					{LA(1) == BLANK &&
 					(
@@ -521,6 +549,22 @@ bash_command_argument_atom
 parens
 	:	LPAREN BLANK? RPAREN;
 
+function_body
+#ifdef OUTPUT_C
+	:	{ctx->lazy_function_bodies && LA(1) == LBRACE && find_lazy_function_body_end(ctx)}? =>
+			lazy_function_body[ctx->lazy_function_body_end]
+	|	compound_command;
+#else
+	:	compound_command;
+#endif
+
+#ifdef OUTPUT_C
+// Only the braces are kept, the body is parsed when the function is called
+lazy_function_body[ANTLR3_MARKER end]
+	:	LBRACE ({LA(1) != ANTLR3_TOKEN_EOF && LT(1)->start < end}? => .)* RBRACE
+		-> ^(LAZY_FUNCTION_BODY LBRACE RBRACE);
+#endif
+
 compound_command
 	:	for_expr
 	|	select_expr
@@ -31,7 +31,8 @@ options
 	#include <string>
 	#include <vector>
 
-	#include <boost/xpressive/xpressive.hpp>
+	#include "core/glob_pattern.h"
+	#include "core/symbol_ids.h"
 
 	class interpreter;
 	void set_interpreter(interpreter* w);
@@ -47,6 +48,7 @@ options
 
 	#include <boost/format.hpp>
 	#include <boost/algorithm/string/join.hpp>
+	#include <boost/xpressive/xpressive.hpp>
 
 	#include "builtins/builtin_exceptions.h"
 	#include "core/bash_ast.h"
@@ -74,59 +76,45 @@ options
 			index = value;
 		}
 
-		// skip to next tree
+		// skip to next tree, the current token should be the root of the tree
 		void seek_to_next_tree(plibbashWalker ctx)
 		{
-			// Current depth of the tree we are traversing
-			int depth = 1;
-
-			// The beginning should always be ROOT DOWN ANY_TOKEN
-			// So we start from LA(4)
-			int index = 4;
-			for(; depth != 0; ++index)
-			{
-				// Go one level done if we encounter DOWN
-				if(LA(index) == DOWN)
-					++depth;
-				// Go one level up if we encounter UP. When depth==0, we finishe one node
-				else if(LA(index) == UP)
-					--depth;
-			}
-
-			// Seek to the correct offset and consume.
-			SEEK(INDEX() + index - 2);
-			CONSUME();
+			SEEK(walker->get_current_ast().get_subtree_end(INDEX()));
 		}
 
 		void skip_next_token_or_tree(plibbashWalker ctx)
 		{
-			if(LA(2) != DOWN)
-				SEEK(INDEX() + 1);
-			else
+			// get_subtree_end also works for leaf nodes
+			seek_to_next_tree(ctx);
+		}
+
+		// skip to the UP token of the current tree
+		void skip_children(plibbashWalker ctx)
+		{
+			while(LA(1) != UP)
 				seek_to_next_tree(ctx);
 		}
 
-		// The method is used to append a pattern with another one. Because it's not allowed to append an empty pattern,
-		// we need the argument 'do_append' to indicate whether the pattern is empty. 'do_append' will be set to true after
-		// the first assignment.
-		void append(boost::xpressive::sregex& pattern, const boost::xpressive::sregex& new_pattern, bool& do_append)
+		void check_extglob()
 		{
-			using namespace boost::xpressive;
-			if(do_append)
-			{
-				pattern = sregex(pattern >> new_pattern);
-			}
-			else
-			{
-				pattern = new_pattern;
-				do_append = true;
-			}
+			if(!walker->get_additional_option("extglob"))
+				throw libbash::unsupported_exception("Entered extended pattern matching with extglob disabled");
 		}
 
-		bool match(const std::string& target,
-				   const boost::xpressive::sregex& pattern)
+		// check whether the nodes from the current one to the end index contain any expansion
+		bool is_static_pattern(plibbashWalker ctx, ANTLR3_MARKER end)
 		{
-		  return boost::xpressive::regex_match(target, pattern);
+			for(int i = 1; INDEX() + i - 1 < end; ++i)
+			{
+				switch(LA(i))
+				{
+					case VAR_REF:
+					case COMMAND_SUB:
+					case ARITHMETIC_EXPRESSION:
+						return false;
+				}
+			}
+			return true;
 		}
 
 		/// \brief parse the text value of a tree to long
@@ -162,6 +150,21 @@ options
 							   boost::numeric_cast<unsigned>(token->stop - token->start - 1));
 		}
 
+		/// \brief append text to a regular expression so that it matches
+		///        literally, like quoted parts of the operand of =~
+		/// \param regex the regular expression
+		/// \param text the literal text
+		void append_regex_literal(std::string& regex, const std::string& text)
+		{
+			static const std::string special_chars("\\^$.|?*+()[]{}");
+			for(auto iter = text.begin(); iter != text.end(); ++iter)
+			{
+				if(special_chars.find(*iter) != std::string::npos)
+					regex += '\\';
+				regex += *iter;
+			}
+		}
+
 		char get_char(pANTLR3_BASE_TREE node)
 		{
 			return *reinterpret_cast<const char *>(node->getToken(node)->start);
@@ -214,16 +217,22 @@ name_base returns[std::string libbash_value]
 	|LETTER { $libbash_value = get_string($LETTER); }
 	|'_' { $libbash_value="_"; };
 
-name returns[std::string libbash_value, unsigned index]
+name returns[std::string libbash_value, unsigned index, symbol_id id]
+@declarations {
+	ANTLR3_MARKER name_index;
+}
 @init {
 	$index = 0;
+	name_index = INDEX();
 }
 	:^(libbash_name=name_base value=arithmetics) {
 		set_index(libbash_name, $index, value);
 		$libbash_value = libbash_name;
+		$id = symbol_id(walker->get_current_ast().resolve_symbol_id(name_index, libbash_name));
 	}
 	|libbash_name=name_base {
 		$libbash_value = libbash_name;
+		$id = symbol_id(walker->get_current_ast().resolve_symbol_id(name_index, libbash_name));
 	};
 
 num returns[std::string libbash_value]
@@ -238,9 +247,9 @@ var_def[bool local]
 }
 	:^(EQUALS name string_expr?) {
 		if(local)
-			walker->define_local($name.libbash_value, $string_expr.libbash_value, false, $name.index);
+			walker->define_local($name.libbash_value, $string_expr.libbash_value, false, $name.index, $name.id);
 		else
-			walker->set_value($name.libbash_value, $string_expr.libbash_value, $name.index);
+			walker->set_value($name.libbash_value, $string_expr.libbash_value, $name.index, $name.id);
 	}
 	|^(EQUALS libbash_name=name_base array_def_helper[libbash_name, values, index]){
 		if(local)
@@ -305,6 +314,17 @@ string_expr returns[std::string libbash_value, bool quoted]
 		}
 	)*);
 
+// The operand of =~. Quoted parts match literally like they do in bash.
+regex_expr returns[std::string libbash_value]
+	:^(STRING (
+		string_part {
+			if($string_part.quoted)
+				append_regex_literal($libbash_value, $string_part.libbash_value);
+			else
+				$libbash_value += $string_part.libbash_value;
+		}
+	)*);
+
 brace_expansion[std::vector<std::string>& elements]
 	:(string_expr{
 		$elements.push_back($string_expr.libbash_value);
@@ -348,85 +368,117 @@ string_part returns[std::string libbash_value, bool quoted, bool is_raw_string]
 		$libbash_value = libbash_string;
 	});
 
-bash_pattern[boost::xpressive::sregex& pattern, bool greedy]
+// Patterns without expansions are compiled once for their AST node. Other
+// patterns are cached by their expanded source text.
+compiled_pattern[bool greedy, glob_pattern::anchor_type anchor] returns[std::shared_ptr<const glob_pattern> pattern]
 @declarations {
-	using namespace boost::xpressive;
-	bool do_append = false;
-	sregex pattern_list;
-	auto check_extglob = [&]() {
-		if(!walker->get_additional_option("extglob"))
-			throw libbash::unsupported_exception("Entered extended pattern matching with extglob disabled");
-	};
+	std::string source;
+	pANTLR3_BASE_TREE node;
+	std::shared_ptr<const glob_pattern> cached;
+	bool is_static = false;
 }
-	:^(STRING (
-		(EXTENDED_MATCH_AT_MOST_ONE) => ^(EXTENDED_MATCH_AT_MOST_ONE composite_pattern[pattern_list, $greedy]) {
-			check_extglob();
-			if($greedy)
-				append($pattern, !sregex(pattern_list), do_append);
-			else
-				append($pattern, -!sregex(pattern_list), do_append);
-		}
-		|(EXTENDED_MATCH_ANY) => ^(EXTENDED_MATCH_ANY composite_pattern[pattern_list, $greedy]) {
-			check_extglob();
-			if($greedy)
-				append($pattern, *sregex(pattern_list), do_append);
-			else
-				append($pattern, -*sregex(pattern_list), do_append);
-		}
-		|(EXTENDED_MATCH_AT_LEAST_ONE) => ^(EXTENDED_MATCH_AT_LEAST_ONE composite_pattern[pattern_list, $greedy]) {
-			check_extglob();
-			if($greedy)
-				append($pattern, +sregex(pattern_list), do_append);
-			else
-				append($pattern, -+sregex(pattern_list), do_append);
-		}
-		// We don't have to do anything for the following rule
-		|(EXTENDED_MATCH_EXACTLY_ONE) => ^(EXTENDED_MATCH_EXACTLY_ONE composite_pattern[pattern_list, $greedy]) {
-			check_extglob();
-			append($pattern, pattern_list, do_append);
-		}
-		|(EXTENDED_MATCH_NONE) => ^(EXTENDED_MATCH_NONE composite_pattern[pattern_list, $greedy]) {
-			check_extglob();
-			throw libbash::unsupported_exception("!(blah) is not supported for now");
+@init {
+	node = LT(1);
+	cached = walker->get_current_ast().get_static_pattern(node);
+	if(!cached)
+		is_static = is_static_pattern(ctx, walker->get_current_ast().get_subtree_end(INDEX()));
+}
+	:^(STRING {
+		if(cached)
+			skip_children(ctx);
+	} (bash_pattern[source])*) {
+		if(cached)
+		{
+			if(cached->uses_extglob())
+				check_extglob();
+			$pattern = cached;
 		}
-		|basic_pattern[$pattern, $greedy, do_append])+);
+		else if(is_static)
+			$pattern = walker->get_current_ast().add_static_pattern(
+				node, std::make_shared<glob_pattern>(source, $greedy, $anchor));
+		else
+			$pattern = walker->get_glob_pattern(source, $greedy, $anchor);
+	};
 
-composite_pattern[boost::xpressive::sregex& pattern_list, bool greedy]
+// The pattern of a case clause is made of the BRANCH nodes that follow
+case_pattern returns[std::shared_ptr<const glob_pattern> pattern]
 @declarations {
-	using namespace boost::xpressive;
-	bool do_append = false;
-	bool do_sub_append = false;
-	sregex sub_pattern;
+	std::string source;
+	pANTLR3_BASE_TREE node;
+	std::shared_ptr<const glob_pattern> cached;
+	bool is_static = false;
 }
-	:(^(BRANCH
-		(basic_pattern[sub_pattern, $greedy, do_sub_append])+ {
-			if(do_append)
-			{
-				$pattern_list = sregex($pattern_list | sub_pattern);
-			}
-			else
-			{
-				$pattern_list = sub_pattern;
-				do_append = true;
-			}
-			do_sub_append = false;
+@init {
+	node = LT(1);
+	cached = walker->get_current_ast().get_static_pattern(node);
+	if(!cached)
+	{
+		ANTLR3_MARKER end = INDEX();
+		while(LA(end - INDEX() + 1) == BRANCH)
+			end = walker->get_current_ast().get_subtree_end(end);
+		is_static = is_static_pattern(ctx, end);
+	}
+}
+	:composite_pattern[source, static_cast<bool>(cached)] {
+		if(cached)
+		{
+			if(cached->uses_extglob())
+				check_extglob();
+			$pattern = cached;
 		}
-	))+;
+		else if(is_static)
+			$pattern = walker->get_current_ast().add_static_pattern(
+				node, std::make_shared<glob_pattern>(source, true));
+		else
+			$pattern = walker->get_glob_pattern(source, true, glob_pattern::anywhere);
+	};
+
+bash_pattern[std::string& source]
+	:(EXTENDED_MATCH_AT_MOST_ONE) => ^(EXTENDED_MATCH_AT_MOST_ONE { $source += "?("; } composite_pattern[$source, false]) {
+		check_extglob();
+		$source += ')';
+	}
+	|(EXTENDED_MATCH_ANY) => ^(EXTENDED_MATCH_ANY { $source += "*("; } composite_pattern[$source, false]) {
+		check_extglob();
+		$source += ')';
+	}
+	|(EXTENDED_MATCH_AT_LEAST_ONE) => ^(EXTENDED_MATCH_AT_LEAST_ONE { $source += "+("; } composite_pattern[$source, false]) {
+		check_extglob();
+		$source += ')';
+	}
+	|(EXTENDED_MATCH_EXACTLY_ONE) => ^(EXTENDED_MATCH_EXACTLY_ONE { $source += "@("; } composite_pattern[$source, false]) {
+		check_extglob();
+		$source += ')';
+	}
+	|(EXTENDED_MATCH_NONE) => ^(EXTENDED_MATCH_NONE { $source += "!("; } composite_pattern[$source, false]) {
+		check_extglob();
+		$source += ')';
+	}
+	|basic_pattern[$source];
 
-basic_pattern[boost::xpressive::sregex& pattern, bool greedy, bool& do_append]
+// The children of the BRANCH nodes are skipped if the pattern is cached
+composite_pattern[std::string& source, bool cached]
+@declarations {
+	bool first = true;
+}
+	:(^(BRANCH {
+		if($cached)
+			skip_children(ctx);
+		else if(!first)
+			$source += '|';
+		first = false;
+	} (basic_pattern[$source])*))+;
+
+basic_pattern[std::string& source]
 @declarations {
-	using namespace boost::xpressive;
 	bool negation;
 	std::string pattern_str;
 }
 	:(MATCH_ALL) => MATCH_ALL {
-		if($greedy)
-			append($pattern, *_, do_append);
-		else
-			append($pattern, -*_, do_append);
+		$source += '*';
 	}
 	|(MATCH_ONE) => MATCH_ONE {
-		append($pattern, _, do_append);
+		$source += '?';
 	}
 	|(MATCH_ANY_EXCEPT|MATCH_ANY) =>
 	^((MATCH_ANY_EXCEPT { negation = true; } | MATCH_ANY { negation = false; })
@@ -440,16 +492,10 @@ basic_pattern[boost::xpressive::sregex& pattern, bool greedy, bool& do_append]
 				pattern_str += "[:" + class_name + ":]";
 		}
 		|s=string_part { pattern_str += s.libbash_value; })+) {
-
-		if(negation)
-			pattern_str = "[^" + pattern_str + "]";
-		else
-			pattern_str = "[" + pattern_str + "]";
-
-		append($pattern, sregex::compile(pattern_str), do_append);
+		glob_pattern::append_bracket($source, pattern_str, negation);
 	}
 	|string_part {
-		append($pattern, as_xpr($string_part.libbash_value), do_append);
+		glob_pattern::append_literal($source, $string_part.libbash_value);
 	};
 
 //double quoted string rule, allows expansions
@@ -481,7 +527,7 @@ options {backtrack = true;}
 	|any_token=. { $libbash_value = get_string(any_token); };
 
 //Allowable variable names in the variable expansion
-var_name returns[std::string libbash_value, unsigned index]
+var_name returns[std::string libbash_value, unsigned index, symbol_id id]
 @init {
 	$var_name.index = 0;
 }
@@ -492,6 +538,7 @@ var_name returns[std::string libbash_value, unsigned index]
 	|name {
 		$libbash_value = $name.libbash_value;
 		$index = $name.index;
+		$id = $name.id;
 	}
 	|^(VAR_REF libbash_string=var_name_for_bang) {
 		$libbash_value = walker->resolve<std::string>(libbash_string);
@@ -518,25 +565,24 @@ array_name returns[std::string libbash_value]
 	|TIMES { $libbash_value = "*"; }
 	|AT { $libbash_value = "*"; };
 
-// Now the rule will call back to parser and perform the expansions
+// Now the rule will call back to parser and perform the expansions. The parsed
+// result is attached to the current AST so we only parse it once.
 raw_string returns[std::string libbash_value]
 @declarations {
 	std::string str;
 }
 	:(^(STRING EMPTY_EXPANSION_VALUE)) => ^(STRING EMPTY_EXPANSION_VALUE)
-	|^(STRING (libbash_string=any_string { str += libbash_string; })+) {
-		bash_ast ast(std::stringstream(str), &bash_ast::parser_all_expansions);
-		libbash_value = ast.interpret_with(*walker, &bash_ast::walker_string_expr);
+	|^(node=STRING (libbash_string=any_string { str += libbash_string; })+) {
+		auto ast = walker->get_current_ast().get_nested_ast(node, str, &bash_ast::parser_all_expansions);
+		libbash_value = ast->interpret_with(*walker, &bash_ast::walker_string_expr);
 	};
 
 var_expansion returns[std::string libbash_value]
 @declarations {
-	using namespace boost::xpressive;
-	sregex replace_pattern;
 	bool greedy;
 }
 	:^(USE_DEFAULT_WHEN_UNSET_OR_NULL var_name libbash_word=raw_string) {
-		libbash_value = walker->do_default_expansion(walker->is_unset_or_null($var_name.libbash_value, $var_name.index),
+		libbash_value = walker->do_default_expansion(walker->is_unset_or_null($var_name.libbash_value, $var_name.index, $var_name.id),
 													 $var_name.libbash_value,
 													 libbash_word,
 													 $var_name.index);
@@ -548,7 +594,7 @@ var_expansion returns[std::string libbash_value]
 													 $var_name.index);
 	}
 	|^(ASSIGN_DEFAULT_WHEN_UNSET_OR_NULL var_name libbash_word=raw_string) {
-		libbash_value = walker->do_assign_expansion(walker->is_unset_or_null($var_name.libbash_value, $var_name.index),
+		libbash_value = walker->do_assign_expansion(walker->is_unset_or_null($var_name.libbash_value, $var_name.index, $var_name.id),
 													$var_name.libbash_value,
 													libbash_word,
 													$var_name.index);
@@ -560,7 +606,7 @@ var_expansion returns[std::string libbash_value]
 													$var_name.index);
 	}
 	|^(USE_ALTERNATE_WHEN_UNSET_OR_NULL var_name libbash_word=raw_string) {
-		libbash_value = walker->do_alternate_expansion(walker->is_unset_or_null($var_name.libbash_value, $var_name.index),
+		libbash_value = walker->do_alternate_expansion(walker->is_unset_or_null($var_name.libbash_value, $var_name.index, $var_name.id),
 		                                               libbash_word);
 	}
 	|^(USE_ALTERNATE_WHEN_UNSET var_name libbash_word=raw_string) {
@@ -590,42 +636,39 @@ var_expansion returns[std::string libbash_value]
 			libbash_value = boost::lexical_cast<std::string>(walker->get_array_length(libbash_name));
 		}
 	))
-	|^(REPLACE_ALL var_or_array_name bash_pattern[replace_pattern, true] (libbash_word=raw_string)?) {
+	|^(REPLACE_ALL var_or_array_name replace_pattern=compiled_pattern[true, glob_pattern::anywhere] (libbash_word=raw_string)?) {
 		libbash_value = replace_expansion($var_or_array_name.libbash_value, $var_or_array_name.index,
 												std::bind(&interpreter::replace_all,
 													std::placeholders::_1,
-													replace_pattern,
+													std::cref(*replace_pattern),
 													libbash_word));
 	}
-	|^(REPLACE_AT_END var_or_array_name bash_pattern[replace_pattern, true] (libbash_word=raw_string)?) {
-		replace_pattern = sregex(replace_pattern >> eos);
+	|^(REPLACE_AT_END var_or_array_name replace_pattern=compiled_pattern[true, glob_pattern::at_end] (libbash_word=raw_string)?) {
 		libbash_value = replace_expansion($var_or_array_name.libbash_value, $var_or_array_name.index,
 												std::bind(&interpreter::replace_all,
 													std::placeholders::_1,
-													replace_pattern,
+													std::cref(*replace_pattern),
 													libbash_word));
 	}
-	|^(LAZY_REMOVE_AT_END var_or_array_name bash_pattern[replace_pattern, false] (libbash_word=raw_string)?) {
-		replace_pattern = sregex(bos >> (s1=*_) >> replace_pattern >> eos);
+	|^(LAZY_REMOVE_AT_END var_or_array_name replace_pattern=compiled_pattern[false, glob_pattern::at_end] (libbash_word=raw_string)?) {
 		libbash_value = replace_expansion($var_or_array_name.libbash_value, $var_or_array_name.index,
 												std::bind(&interpreter::lazy_remove_at_end,
 													std::placeholders::_1,
-													replace_pattern));
+													std::cref(*replace_pattern)));
 	}
 	|^((REPLACE_AT_START { greedy = true; }|LAZY_REMOVE_AT_START { greedy = false; })
-		var_or_array_name bash_pattern[replace_pattern, greedy] (libbash_word=raw_string)?) {
-		replace_pattern = sregex(bos >> replace_pattern);
+		var_or_array_name replace_pattern=compiled_pattern[greedy, glob_pattern::at_start] (libbash_word=raw_string)?) {
 		libbash_value = replace_expansion($var_or_array_name.libbash_value, $var_or_array_name.index,
 												std::bind(&interpreter::replace_all,
 													std::placeholders::_1,
-													replace_pattern,
+													std::cref(*replace_pattern),
 													libbash_word));
 	}
-	|^(REPLACE_FIRST var_or_array_name bash_pattern[replace_pattern, true] (libbash_word=raw_string)?) {
+	|^(REPLACE_FIRST var_or_array_name replace_pattern=compiled_pattern[true, glob_pattern::anywhere] (libbash_word=raw_string)?) {
 		libbash_value = replace_expansion($var_or_array_name.libbash_value, $var_or_array_name.index,
 												std::bind(&interpreter::replace_first,
 													std::placeholders::_1,
-													replace_pattern,
+													std::cref(*replace_pattern),
 													libbash_word));
 	};
 
@@ -648,7 +691,7 @@ word returns[std::string libbash_value]
 //variable reference
 var_ref [bool double_quoted] returns[std::string libbash_value]
 	:^(VAR_REF var_name) {
-		$libbash_value = walker->resolve<std::string>($var_name.libbash_value, $var_name.index);
+		$libbash_value = walker->resolve<std::string>($var_name.libbash_value, $var_name.index, $var_name.id);
 	}
 	|^(VAR_REF libbash_string=array_name) { walker->get_all_elements_IFS_joined(libbash_string, $libbash_value); }
 	|^(VAR_REF POUND) { $libbash_value = boost::lexical_cast<std::string>(walker->get_array_length("*")); }
@@ -682,7 +725,12 @@ execute_command[std::string& name, std::vector<std::string>& libbash_args]
 	std::unique_ptr<interpreter::local_scope> current_scope;
 }
 @init {
-	if(name != "local" && name != "set" && name != "declare" && name != "eval")
+	// Only prefix assignments, function arguments and builtins that run
+	// scripts or define variables need a local scope. local and declare at
+	// the top level of a sourced script use the scope of source.
+	if(name != "local" && name != "set" && name != "declare" && name != "eval"
+	   && (LA(1) == EQUALS || LA(1) == PLUS_ASSIGN || walker->has_function(name)
+	       || name == "source" || name == "." || name == "inherit" || name == "export"))
 		current_scope.reset(new interpreter::local_scope(*walker));
 }
 	:var_def[true]* {
@@ -738,6 +786,7 @@ redirect_operator
 redirect_destination_output
 	:string_expr {
 		walker->set_output_stream(new std::ofstream($string_expr.libbash_value, std::ofstream::trunc));
+		walker->invalidate_file_status($string_expr.libbash_value);
 	}
 	|FILE_DESCRIPTOR DIGIT {
 		std::cerr << "FILE_DESCRIPTOR redirection is not supported yet" << std::endl;
@@ -797,9 +846,6 @@ cond_expr
 	|^(KEYWORD_TEST status=keyword_condition) { walker->set_status(!status); };
 
 common_condition returns[bool status]
-@declarations {
-	boost::xpressive::sregex pattern;
-}
 	// -eq, -ne, -lt, -le, -gt, or -ge for arithmetic. -nt -ot -ef for files
 	:^(NAME left_str=string_expr right_str=string_expr) {
 		$status = internal::test_binary(get_string($NAME), left_str.libbash_value, right_str.libbash_value, *walker);
@@ -807,21 +853,22 @@ common_condition returns[bool status]
 	// -o for shell option,  -z -n for string, -abcdefghkprstuwxOGLSN for files
 	|^(op=LETTER string_expr) {
 		$status = internal::test_unary(get_char(op),
-		                               $string_expr.libbash_value);
+		                               $string_expr.libbash_value,
+		                               walker->get_file_status_cache());
 	}
 	|^(EQUALS left_str=string_expr right_str=string_expr) {
 		$status = left_str.libbash_value == right_str.libbash_value;
 	}
 	// Greedy is meaningless as we need to match the whole string
-	|^(MATCH_PATTERN left_str=string_expr bash_pattern[pattern, false]) {
-		$status = match(left_str.libbash_value, pattern);
+	|^(MATCH_PATTERN left_str=string_expr pattern=compiled_pattern[false, glob_pattern::anywhere]) {
+		$status = pattern->match(left_str.libbash_value);
 	}
 	|^(NOT_EQUALS left_str=string_expr right_str=string_expr) {
 		$status = left_str.libbash_value != right_str.libbash_value;
 	}
 	// Greedy is meaningless as we need to match the whole string
-	|^(NOT_MATCH_PATTERN left_str=string_expr bash_pattern[pattern, false]) {
-		$status = !match(left_str.libbash_value, pattern);
+	|^(NOT_MATCH_PATTERN left_str=string_expr pattern=compiled_pattern[false, glob_pattern::anywhere]) {
+		$status = !pattern->match(left_str.libbash_value);
 	}
 	|^(LESS_THAN left_str=string_expr right_str=string_expr) {
 		$status = left_str.libbash_value < right_str.libbash_value;
@@ -832,6 +879,10 @@ common_condition returns[bool status]
 	|string_expr { $status = (!$string_expr.libbash_value.empty()); };
 
 keyword_condition returns[bool status]
+@declarations {
+	pANTLR3_BASE_TREE regex_node;
+	bool is_static;
+}
 	:^(LOGICOR l=keyword_condition {
 			if(l){
 				seek_to_next_tree(ctx);
@@ -847,11 +898,28 @@ keyword_condition returns[bool status]
 			}
 	} r=keyword_condition) { $status= l && r; }
 	|^(NEGATION l=keyword_condition) { $status = !l; }
-	|^(MATCH_REGULAR_EXPRESSION left_str=string_expr right_str=string_expr) {
-		bash_ast ast(std::stringstream(right_str.libbash_value), &bash_ast::parser_all_expansions, false);
-		std::string pattern = ast.interpret_with(*walker, &bash_ast::walker_string_expr);
-		boost::xpressive::sregex re = boost::xpressive::sregex::compile(pattern);
-		$status = boost::xpressive::regex_match(left_str.libbash_value, re);
+	|^(MATCH_REGULAR_EXPRESSION left_str=string_expr {
+		regex_node = LT(1);
+		is_static = is_static_pattern(ctx, walker->get_current_ast().get_subtree_end(INDEX()));
+	} right_str=string_expr) {
+		std::string pattern;
+		// Only quotes, escapes, braces and expansions are changed by the parser
+		if(right_str.libbash_value.find_first_of("$`\"'\\{") == std::string::npos)
+		{
+			pattern = right_str.libbash_value;
+		}
+		else if(is_static)
+		{
+			auto ast = walker->get_current_ast().get_nested_ast(regex_node, right_str.libbash_value,
+			                                                    &bash_ast::parser_all_expansions, false);
+			pattern = ast->interpret_with(*walker, &bash_ast::walker_regex_expr);
+		}
+		else
+		{
+			bash_ast ast(std::stringstream(right_str.libbash_value), &bash_ast::parser_all_expansions, false);
+			pattern = ast.interpret_with(*walker, &bash_ast::walker_regex_expr);
+		}
+		$status = walker->match_regex(left_str.libbash_value, pattern);
 	}
 	|s=common_condition { $status = s; };
 
@@ -873,7 +941,8 @@ builtin_condition_primary returns[bool status]
 for_expr
 @declarations {
 	ANTLR3_MARKER commands_index;
-	std::vector<std::string> splitted_values;
+	// the words and whether they are quoted
+	std::vector<std::pair<std::string, bool>> words;
 	bool in_array = false;
 
 	ANTLR3_MARKER condition_index;
@@ -881,30 +950,53 @@ for_expr
 	:^(FOR libbash_string=name_base
 		(string_expr
 		{
-			// Word splitting happens here
-			if($string_expr.quoted)
-				splitted_values.push_back($string_expr.libbash_value);
-			else
-				walker->split_word($string_expr.libbash_value, splitted_values);
+			words.push_back(std::make_pair($string_expr.libbash_value, $string_expr.quoted));
 			in_array = true;
 		}
 		)*
 		{
-			if(splitted_values.empty() && in_array)
+			if(!in_array)
+			{
+				std::vector<std::string> positional_args;
+				walker->resolve_array<std::string>("*", positional_args);
+				for(auto iter = positional_args.begin(); iter != positional_args.end(); ++iter)
+					words.push_back(std::make_pair(*iter, true));
+			}
+
+			// Word splitting happens here, one field at a time so that a loop
+			// that breaks early doesn't split the rest of the words
+			interpreter::field_splitter splitter(walker->get_field_splitter());
+			auto word = words.begin();
+			std::string::size_type position = 0;
+			std::string value;
+			auto next_value = [&]() -> bool {
+				for(; word != words.end(); ++word, position = 0)
+				{
+					if(word->second)
+					{
+						value = word->first;
+						++word;
+						return true;
+					}
+					if(splitter.next(word->first, position, value))
+						return true;
+				}
+				return false;
+			};
+
+			if(!next_value())
 			{
 				//skip the body
 				seek_to_next_tree(ctx);
-				walker->set_status(0);
+				if(in_array)
+					walker->set_status(0);
 			}
 			else
 			{
-				if(!in_array)
-					walker->resolve_array<std::string>("*", splitted_values);
-
 				commands_index = INDEX();
-				for(auto iter = splitted_values.begin(); iter != splitted_values.end(); ++iter)
+				do
 				{
-					walker->set_value(libbash_string, *iter);
+					walker->set_value(libbash_string, value);
 					try
 					{
 						command_list(ctx);
@@ -921,6 +1013,7 @@ for_expr
 					}
 					SEEK(commands_index);
 				}
+				while(next_value());
 				seek_to_next_tree(ctx);
 			}
 		})
@@ -1096,7 +1189,47 @@ elif_expr returns[bool matched]
 	});
 
 case_expr
-	:^(CASE libbash_string=word (matched=case_clause[libbash_string]{
+@declarations {
+	std::shared_ptr<const glob_pattern_set> patterns;
+	int first_match = -1;
+	unsigned clause = 0;
+}
+	:^(node=CASE libbash_string=word {
+		patterns = walker->get_current_ast().get_case_patterns(node);
+		if(!patterns)
+		{
+			// Clauses are only compiled when they are reached, so the clauses
+			// without expansions are put together once all of them are compiled
+			std::shared_ptr<glob_pattern_set> new_patterns(new glob_pattern_set);
+			bool compiled = true;
+			ANTLR3_MARKER start = INDEX();
+			while(compiled && LA(1) == CASE_PATTERN)
+			{
+				ANTLR3_MARKER clause_end = walker->get_current_ast().get_subtree_end(INDEX());
+				std::shared_ptr<const glob_pattern> pattern;
+				if(LA(2) == ANTLR3_TOKEN_DOWN && LA(3) == BRANCH)
+				{
+					SEEK(INDEX() + 2);
+					ANTLR3_MARKER end = INDEX();
+					while(LA(end - INDEX() + 1) == BRANCH)
+						end = walker->get_current_ast().get_subtree_end(end);
+					if(is_static_pattern(ctx, end))
+					{
+						pattern = walker->get_current_ast().get_static_pattern(LT(1));
+						compiled = static_cast<bool>(pattern);
+					}
+				}
+				new_patterns->add(pattern);
+				SEEK(clause_end);
+			}
+			SEEK(start);
+			if(compiled)
+				patterns = walker->get_current_ast().add_case_patterns(node, new_patterns);
+		}
+		if(patterns)
+			first_match = patterns->find(libbash_string);
+	} (matched=case_clause[libbash_string, patterns.get(), clause, first_match]{
+		++clause;
 		if(matched)
 		{
 			while(LA(1) == CASE_PATTERN)
@@ -1104,12 +1237,21 @@ case_expr
 		}
 	})*);
 
-case_clause[const std::string& target] returns[bool matched]
+// Once the clauses without expansions are all compiled, case_expr matches
+// them at once and only the first matching one is entered
+case_clause[const std::string& target, const glob_pattern_set* patterns, unsigned clause, int first_match] returns[bool matched]
 @declarations {
-	boost::xpressive::sregex pattern;
+	bool skipped;
+}
+@init {
+	$matched = false;
+	skipped = patterns && patterns->is_static(clause) && static_cast<int>(clause) != first_match;
 }
-	:^(CASE_PATTERN composite_pattern[pattern, true] {
-		if(match(target, pattern))
+	:^(CASE_PATTERN {
+		if(skipped)
+			skip_children(ctx);
+	} (pattern=case_pattern {
+		if(static_cast<int>(clause) == first_match || pattern->match(target))
 		{
 			if(LA(1) == CASE_COMMAND)
 			{
@@ -1119,14 +1261,11 @@ case_clause[const std::string& target] returns[bool matched]
 			}
 			$matched = true;
 		}
-		else
+		else if(LA(1) == CASE_COMMAND)
 		{
-			$matched = false;
-			if(LA(1) == CASE_COMMAND)
-				seek_to_next_tree(ctx);
+			seek_to_next_tree(ctx);
 		}
-	})
-	|CASE_PATTERN;
+	})?);
 
 command_substitution returns[std::string libbash_value]
 @declarations {
@@ -1158,21 +1297,27 @@ function_definition returns[int placeholder]
 }
 	// We've already validated the function name in parser grammar so here we just use any_string to match the name.
 	:^(FUNCTION ^(STRING (libbash_string=any_string { function_name += libbash_string; })+) {
-		// Define the function with current index
-		walker->define_function(function_name, INDEX());
+		if(LA(1) == LAZY_FUNCTION_BODY)
+			// The body will be parsed when the function is called
+			walker->define_lazy_function(function_name, LT(1));
+		else
+			// Define the function with current index
+			walker->define_function(function_name, INDEX());
 		// Skip the AST for function body
 		seek_to_next_tree(ctx);
 	});
 
 // Only used in arithmetic expansion
-primary returns[std::string libbash_value, unsigned index]
+primary returns[std::string libbash_value, unsigned index, symbol_id id]
 	:(^(VAR_REF name)) => ^(VAR_REF name) {
 		$libbash_value = $name.libbash_value;
 		$index = $name.index;
+		$id = $name.id;
 	}
 	|name {
 		$libbash_value = $name.libbash_value;
 		$index = $name.index;
+		$id = $name.id;
 	}
 	// array[@] and array[*] is meaningless to arithmetic expansion so true/false are both ok.
 	|^(VAR_REF libbash_string=var_ref[false]) {
@@ -1245,97 +1390,97 @@ arithmetic returns[long value]
 		$value = (cnd ? l : r);
 	}
 	|primary {
-		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index));
+		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index, $primary.id));
 		$value = (primary_value.empty() ? 0 : walker->eval_arithmetic(primary_value));
 	}
 	|^(PRE_INCR primary) {
-		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index));
+		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index, $primary.id));
 		if(is_number(primary_value))
 			$value = walker->set_value($primary.libbash_value,
-									   walker->resolve<long>($primary.libbash_value, $primary.index) + 1,
-									   $primary.index);
+									   walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) + 1,
+									   $primary.index, $primary.id);
 		else
 			$value = (primary_value.empty() ? 0 : walker->eval_arithmetic("++" + primary_value));
 	}
 	|^(PRE_DECR primary) {
-		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index));
+		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index, $primary.id));
 		if(is_number(primary_value))
 			$value = walker->set_value($primary.libbash_value,
-									   walker->resolve<long>($primary.libbash_value, $primary.index) - 1,
-									   $primary.index);
+									   walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) - 1,
+									   $primary.index, $primary.id);
 		else
 			$value = (primary_value.empty() ? 0 : walker->eval_arithmetic("--" + primary_value));
 	}
 	|^(POST_INCR primary) {
-		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index));
+		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index, $primary.id));
 		if(is_number(primary_value))
 			$value = walker->set_value($primary.libbash_value,
-									   walker->resolve<long>($primary.libbash_value, $primary.index) + 1,
-									   $primary.index) - 1;
+									   walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) + 1,
+									   $primary.index, $primary.id) - 1;
 		else
 			$value = (primary_value.empty() ? 0 : walker->eval_arithmetic(primary_value + "++"));
 	}
 	|^(POST_DECR primary) {
-		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index));
+		std::string primary_value(walker->resolve<std::string>($primary.libbash_value, $primary.index, $primary.id));
 		if(is_number(primary_value))
 			$value = walker->set_value($primary.libbash_value,
-									   walker->resolve<long>($primary.libbash_value, $primary.index) - 1,
-									   $primary.index) + 1;
+									   walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) - 1,
+									   $primary.index, $primary.id) + 1;
 		else
 			$value = (primary_value.empty() ? 0 : walker->eval_arithmetic(primary_value + "--"));
 	}
 	|^(EQUALS primary l=arithmetics) {
-		$value = walker->set_value($primary.libbash_value, l, $primary.index);
+		$value = walker->set_value($primary.libbash_value, l, $primary.index, $primary.id);
 	}
 	|^(MUL_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) * l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) * l,
+								   $primary.index, $primary.id);
 	}
 	|^(DIVIDE_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) / l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) / l,
+								   $primary.index, $primary.id);
 	}
 	|^(MOD_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) \% l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) \% l,
+								   $primary.index, $primary.id);
 	}
 	|^(PLUS_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) + l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) + l,
+								   $primary.index, $primary.id);
 	}
 	|^(MINUS_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) - l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) - l,
+								   $primary.index, $primary.id);
 	}
 	|^(LSHIFT_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) << l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) << l,
+								   $primary.index, $primary.id);
 	}
 	|^(RSHIFT_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) >> l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) >> l,
+								   $primary.index, $primary.id);
 	}
 	|^(AND_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) & l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) & l,
+								   $primary.index, $primary.id);
 	}
 	|^(XOR_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) ^ l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) ^ l,
+								   $primary.index, $primary.id);
 	}
 	|^(OR_ASSIGN primary l=arithmetics) {
 		$value = walker->set_value($primary.libbash_value,
-		                           walker->resolve<long>($primary.libbash_value, $primary.index) | l,
-								   $primary.index);
+		                           walker->resolve<long>($primary.libbash_value, $primary.index, $primary.id) | l,
+								   $primary.index, $primary.id);
 	}
 	| NUMBER { $value = parse_integer($NUMBER);}
 	| DIGIT { $value = parse_integer($DIGIT);}
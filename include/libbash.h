@@ -32,6 +32,9 @@
 #include "common.h"
 #include "exceptions.h"
 
+class interpreter;
+class bash_ast;
+
 /// \namespace libbash
 /// \brief public namespace for libbash API
 namespace libbash
@@ -59,6 +62,68 @@ namespace libbash
                             const std::string& preload_path,
                             std::unordered_map<std::string, std::vector<std::string>>& variables,
                             std::vector<std::string>& functions);
+
+  ///
+  /// \class snapshot
+  /// \brief the state of an interpreter after interpreting a preload script.
+  ///        Scripts interpreted with a snapshot start from a copy-on-write
+  ///        clone of the state so the preload script only runs once. A
+  ///        snapshot can be used by several threads at the same time.
+  class LIBBASH_API snapshot
+  {
+    std::shared_ptr<bash_ast> preload_ast;
+    std::shared_ptr<const interpreter> base;
+  public:
+    ///
+    /// \brief interpret the preload script and keep the resulting state
+    /// \param preload_path the path of the preload script
+    explicit snapshot(const std::string& preload_path);
+
+    ///
+    /// \brief interpret a script specified by path from the preloaded state
+    /// \param target_path the path of target script
+    /// \param[in, out] variables used to initialize bash environment and store the variable values. The environment will be initialized after preloading.
+    /// \param[out] functions store the names of the functions defined in the script
+    /// \return the return status of the script
+    int interpret(const std::string& target_path,
+                  std::unordered_map<std::string, std::vector<std::string>>& variables,
+                  std::vector<std::string>& functions) const;
+  };
+
+  ///
+  /// \brief enable the on-disk cache of parsed scripts. Sourced scripts will
+  ///        be loaded from the cache instead of being parsed again. Cache
+  ///        entries are keyed by the script content so changed scripts are
+  ///        parsed again. This overrides the LIBBASH_AST_CACHE_DIR environment
+  ///        variable and should be called before interpreting any script.
+  /// \param directory an existing directory for the cache, empty to disable the cache
+  void LIBBASH_API set_ast_cache_directory(const std::string& directory);
+
+  ///
+  /// \brief parse the bodies of functions defined in scripts only when the
+  ///        functions are called. This saves time when most functions are
+  ///        never called, such as metadata generation. Syntax errors in
+  ///        function bodies are reported on the first call then. It should
+  ///        be called before interpreting any script.
+  /// \param lazy whether to parse function bodies lazily
+  void LIBBASH_API set_lazy_function_bodies(bool lazy);
+
+  ///
+  /// \brief cache the results of stat, lstat and access used by the file
+  ///        test operators. The cache is shared by all the scripts
+  ///        interpreted afterwards, so it should only be enabled when the
+  ///        file system doesn't change during the run. Files written by the
+  ///        scripts through redirection are checked again. Enabling the
+  ///        cache again starts with an empty cache. It should be called
+  ///        before interpreting any script.
+  /// \param enabled whether to cache the file status
+  void LIBBASH_API set_file_status_cache(bool enabled);
+
+  ///
+  /// \brief get the statistics of the file status cache
+  /// \param[out] hits the number of lookups answered from the cache
+  /// \param[out] misses the number of lookups that queried the file system
+  void LIBBASH_API get_file_status_cache_statistics(unsigned long& hits, unsigned long& misses);
 }
 
 #endif
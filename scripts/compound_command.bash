@@ -407,3 +407,35 @@ if [[   1 == 1 &&
         1 == 1 && 1 == 1 ]]; then
         echo and or
 fi
+
+words="a b  c"
+old_ifs="$IFS"
+for foo in $words "d e" $words
+do
+    IFS=:
+    echo "$foo"
+    [[ $foo == "d e" ]] && break
+done
+IFS="$old_ifs"
+
+dynamic=x86-fbsd
+for target in x86 x86-fbsd arm ppc
+do
+    case $target in
+        amd64|x86)
+            echo "$target: first"
+            ;;
+        $dynamic)
+            echo "$target: dynamic"
+            ;;
+        x86*|arm)
+            echo "$target: pattern"
+            ;;
+        arm)
+            echo "Shouldn't print this"
+            ;;
+        *)
+            echo "$target: default"
+            ;;
+    esac
+done
@@ -0,0 +1,2 @@
+local FOO003=local
+echo $FOO003
@@ -44,12 +44,28 @@ echo $? # 0
 [[ "abc def xyz" != *"defg"* ]] && echo "true14"
 shopt -s extglob
 [[ "123" == *([[:digit:]]) ]] && echo "true15"
+[[ "abc" == !(b*) ]] && echo "true15.1"
+[[ "bcd" == !(b*) ]] && echo "wrong"
+[[ "^" == [!^a] ]] && echo "wrong"
+[[ "b" == [!^a] ]] && echo "true15.2"
 i=2
 [[ i++ -gt 2 ]] && echo wrong
 [[ i++ -gt 2 ]] && echo true16
 unset i
 [[ "setup.py" =~ ^(setup\.py|nosetests|py\.test|trial(\ .*)?)$ ]] && echo true17
 [[ "setup.py" =~ ^(setup\.p|nosetests|py\.test|trial(\ .*)?)$ ]] && echo false
+for version in foo-1.2 bar-3.4 baz
+do
+    [[ $version =~ ^([a-z]+)-([0-9])\.([0-9])$ ]] && echo "${BASH_REMATCH[0]} ${BASH_REMATCH[1]} ${BASH_REMATCH[3]}"
+done
+echo ${#BASH_REMATCH[@]}
+[[ abc =~ b ]] && echo true17.1
+[[ foo-1.2x =~ ([0-9])\.([0-9]) ]] && echo "${BASH_REMATCH[0]} ${BASH_REMATCH[2]}"
+[[ "a b" =~ " *" ]] && echo wrong
+[[ "a *" =~ " *"$ ]] && echo true17.2
+regex="a.c"
+[[ abc =~ $regex ]] && echo true17.3
+[[ abc =~ "$regex" ]] && echo wrong
 [ abc = bcd -o abc = abc ] && echo true18
 [ abc = bcd -a abc = abc ] || echo true19
 [[ =a <=b ]]
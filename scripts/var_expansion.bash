@@ -156,3 +156,20 @@ version_components_group_regex="(2|3|\*)(:([[:digit:]]+\.[[:digit:]]+)?(:([[:dig
 version_components_groups="${PYTHON_DEPEND}"
 [[ "${version_components_groups}" =~ ^((\!)?[[:alnum:]_-]+\?\ )?${version_components_group_regex}(\ ${version_components_group_regex})?$ ]] && echo true
 [[ "${version_components_groups}" =~ ("*".*" "|" *"|^2.*\ (2|\*)|^3.*\ (3|\*)) ]] && echo true
+for i in 1 2 3
+do
+    echo "${NOT_EXIST:-default $i}" ${i/#[0-9]/${NOT_EXIST:-$i$i}}
+done
+for suffix in .gz .bz2 .gz
+do
+    file="foo.tar${suffix}"
+    echo ${file%.tar*} ${file%${suffix}} ${file##*.} ${file//./_}
+    case ${file} in
+        *.gz) echo gzip ;;
+        *${suffix}) echo "matched ${suffix}" ;;
+    esac
+done
+FOO043=abc
+echo "${FOO043//?(z)/-}" "${FOO043/?(z)/-}" "${FOO043//*(b)/-}" "${FOO043//@(a|ab)/-}" "${FOO043##@(a|ab)}" "${FOO043%!(c)}"
+FOO044=
+echo "${FOO044//*/-}" "${FOO044/#*/-}"
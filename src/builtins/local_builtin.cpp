@@ -32,6 +32,12 @@
 
 int local_builtin::exec(const std::vector<std::string>& bash_args)
 {
+  if(!_walker.is_local_scope())
+  {
+    err_buffer() << "local: can only be used in a function" << std::endl;
+    return 1;
+  }
+
   std::stringstream script;
   for(auto iter = bash_args.begin(); iter != bash_args.end(); ++iter)
       script << *iter;
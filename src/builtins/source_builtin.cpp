@@ -24,11 +24,14 @@
 #include "builtins/source_builtin.h"
 
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <string>
 #include <unordered_map>
 #include <thread>
 
+#include <pthread.h>
+
 #include "builtins/builtin_exceptions.h"
 #include "cppbash_builtin.h"
 #include "core/interpreter.h"
@@ -36,29 +39,95 @@
 #include "exceptions.h"
 
 namespace {
-  std::mutex parse_mutex;
+  typedef std::shared_future<std::shared_ptr<bash_ast>> ast_future;
 
-  std::shared_ptr<bash_ast>& parse(const std::string& path)
+  /// \brief a part of the AST cache. Paths are spread over the shards so
+  ///        that different paths rarely contend for the same lock.
+  struct cache_shard
   {
-    static std::unordered_map<std::string, std::shared_ptr<bash_ast>> ast_cache;
+    pthread_rwlock_t lock;
+    std::unordered_map<std::string, ast_future> asts;
 
-    std::lock_guard<std::mutex> parse_lock(parse_mutex);
+    cache_shard()
+    {
+      pthread_rwlock_init(&lock, NULL);
+    }
+
+    ~cache_shard()
+    {
+      pthread_rwlock_destroy(&lock);
+    }
+  };
 
-    auto stored_ast = ast_cache.find(path);
-    if(stored_ast == ast_cache.end())
+  class shard_lock
+  {
+    pthread_rwlock_t& lock;
+  public:
+    shard_lock(pthread_rwlock_t& l, bool exclusive): lock(l)
     {
-      // ensure the path is cached
-      auto iter = ast_cache.insert(make_pair(path, std::shared_ptr<bash_ast>()));
-      // this may throw exception
-      iter.first->second.reset(new bash_ast(path));
-      stored_ast = iter.first;
+      if(exclusive)
+        pthread_rwlock_wrlock(&lock);
+      else
+        pthread_rwlock_rdlock(&lock);
     }
-    else if(!(stored_ast->second))
+
+    ~shard_lock()
     {
-      throw libbash::parse_exception(path + " cannot be fully parsed");
+      pthread_rwlock_unlock(&lock);
     }
+  };
+
+  const std::size_t shard_count = 16;
+  cache_shard ast_cache[shard_count];
 
-    return stored_ast->second;
+  std::shared_ptr<bash_ast> parse(const std::string& path)
+  {
+    cache_shard& shard = ast_cache[std::hash<std::string>()(path) % shard_count];
+    ast_future stored_ast;
+
+    {
+      shard_lock read_lock(shard.lock, false);
+      auto iter = shard.asts.find(path);
+      if(iter != shard.asts.end())
+        stored_ast = iter->second;
+    }
+
+    if(!stored_ast.valid())
+    {
+      std::promise<std::shared_ptr<bash_ast>> parsed;
+      bool parse_here = false;
+      {
+        shard_lock write_lock(shard.lock, true);
+        auto iter = shard.asts.insert(std::make_pair(path, ast_future()));
+        if(iter.second)
+        {
+          iter.first->second = parsed.get_future().share();
+          parse_here = true;
+        }
+        stored_ast = iter.first->second;
+      }
+
+      // Parse without holding the lock. Other threads that source the same
+      // path wait for the result.
+      if(parse_here)
+      {
+        try
+        {
+          parsed.set_value(std::shared_ptr<bash_ast>(new bash_ast(path)));
+        }
+        catch(...)
+        {
+          // a failed parse is cached as a null pointer
+          parsed.set_value(std::shared_ptr<bash_ast>());
+          throw;
+        }
+      }
+    }
+
+    std::shared_ptr<bash_ast> result = stored_ast.get();
+    if(!result)
+      throw libbash::parse_exception(path + " cannot be fully parsed");
+    return result;
   }
 }
 
@@ -22,11 +22,15 @@
 ///
 
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "builtins/builtin_exceptions.h"
+#include "core/bash_ast.h"
 #include "core/interpreter.h"
 #include "cppbash_builtin.h"
 #include "test.h"
@@ -83,6 +87,22 @@ TEST(source_builtin_test, source_return)
   EXPECT_TRUE(walker.is_unset_or_null("NOT_EXIST", 0));
 }
 
+TEST(source_builtin_test, source_local)
+{
+  // local at the top level of a sourced script uses the scope of source
+  bash_ast ast(std::stringstream("source " + get_src_dir() + "/scripts/source_local.sh\n"
+                                 "echo ${FOO003-unset}"));
+  interpreter walker;
+  std::stringstream output;
+  walker.set_output_stream(&output);
+  ast.interpret_with(walker);
+  EXPECT_STREQ("local\nunset\n", output.str().c_str());
+
+  // It is rejected outside of any scope
+  EXPECT_EQ(1, cppbash_builtin::exec("local", {"FOO003=local"}, output, output, std::cin, walker));
+  EXPECT_TRUE(walker.is_unset_or_null("FOO003", 0));
+}
+
 TEST(source_builtin_test, invalid)
 {
   interpreter walker;
@@ -100,4 +120,30 @@ TEST(source_builtin_test, invalid)
                                      std::cin,
                                      walker),
                libbash::parse_exception);
+  // The failure is cached
+  EXPECT_THROW(cppbash_builtin::exec("source",
+                                     {get_src_dir() + "/scripts/illegal_script.sh"},
+                                     std::cout,
+                                     std::cerr,
+                                     std::cin,
+                                     walker),
+               libbash::parse_exception);
+}
+
+TEST(source_builtin_test, concurrent_source)
+{
+  const std::string path(get_src_dir() + "/scripts/source_return.sh");
+  std::vector<int> statuses(8);
+  std::vector<std::thread> threads;
+  for(auto iter = statuses.begin(); iter != statuses.end(); ++iter)
+    threads.push_back(std::thread([&path, iter]() {
+      interpreter walker;
+      std::stringstream output;
+      *iter = cppbash_builtin::exec("source", {path}, output, output, std::cin, walker);
+    }));
+  for(auto iter = threads.begin(); iter != threads.end(); ++iter)
+    iter->join();
+
+  for(auto iter = statuses.begin(); iter != statuses.end(); ++iter)
+    EXPECT_EQ(10, *iter);
 }
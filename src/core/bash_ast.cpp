@@ -22,16 +22,27 @@
 ///
 #include "core/bash_ast.h"
 
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <thread>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <boost/algorithm/string/erase.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 
 #include "core/interpreter.h"
+#include "core/symbol_ids.h"
 #include "exceptions.h"
+#include "grammar_stamp.h"
 #include "libbashLexer.h"
 #include "libbashParser.h"
 #include "libbashWalker.h"
@@ -51,7 +62,7 @@ bash_ast::bash_ast(const std::istream& source,
                    bool trim): parse(p)
 {
   read_script(source, trim);
-  init_parser("unknown source");
+  init_parser("unknown source", false);
 }
 
 bash_ast::bash_ast(const std::string& script_path,
@@ -64,32 +75,86 @@ bash_ast::bash_ast(const std::string& script_path,
     throw libbash::parse_exception(script_path + " can't be read");
 
   read_script(file_stream, trim);
-  init_parser(script_path);
+  init_parser(script_path, true);
+}
+
+bash_ast::~bash_ast()
+{
+  for(auto iter = idle_node_streams.begin(); iter != idle_node_streams.end(); ++iter)
+    (*iter)->free(*iter);
 }
 
 namespace
 {
-  std::mutex string_mutex;
+  // Each walker creates its strings through its own factory, which is
+  // closed with the walker. The ANTLR runtime keeps some strings in the
+  // text of tokens, so those are created through the factory of the AST
+  // before any walker runs. Strings created outside of walkers also use
+  // the factory of the AST, which is guarded by one of a fixed set of
+  // locks. The default implementations are taken from a factory that is
+  // never used otherwise.
+  __thread pANTLR3_STRING_FACTORY* walker_factory = 0;
+
+  const unsigned string_lock_count = 16;
+  std::mutex string_mutexes[string_lock_count];
+
+  std::mutex& get_string_mutex(pANTLR3_STRING_FACTORY factory)
+  {
+    return string_mutexes[reinterpret_cast<std::uintptr_t>(factory) / sizeof(*factory) % string_lock_count];
+  }
+
+  pANTLR3_STRING_FACTORY get_pristine_factory()
+  {
+    static pANTLR3_STRING_FACTORY pristine = antlr3StringFactoryNew();
+    return pristine;
+  }
 
   pANTLR3_STRING locked_newRaw8(pANTLR3_STRING_FACTORY factory)
   {
-    std::lock_guard<std::mutex> l(string_mutex);
-    pANTLR3_STRING_FACTORY pristine = antlr3StringFactoryNew();
-    pANTLR3_STRING result = pristine->newRaw(factory);
-    pristine->close(pristine);
-    return result;
+    if(walker_factory && (*walker_factory || (*walker_factory = antlr3StringFactoryNew())))
+      return (*walker_factory)->newRaw(*walker_factory);
+
+    std::lock_guard<std::mutex> l(get_string_mutex(factory));
+    return get_pristine_factory()->newRaw(factory);
   }
 
   void locked_destroy(pANTLR3_STRING_FACTORY factory, pANTLR3_STRING string)
   {
-    std::lock_guard<std::mutex> l(string_mutex);
-    pANTLR3_STRING_FACTORY pristine = antlr3StringFactoryNew();
-    pristine->destroy(factory, string);
-    pristine->close(pristine);
+    std::lock_guard<std::mutex> l(get_string_mutex(factory));
+    get_pristine_factory()->destroy(factory, string);
+  }
+
+  // Whether function bodies in script files are parsed on the first call
+  bool& lazy_function_bodies()
+  {
+    static bool lazy = false;
+    return lazy;
+  }
+
+  void create_token_texts(pANTLR3_BASE_TREE tree)
+  {
+    if(!tree->isNilNode(tree))
+    {
+      pANTLR3_COMMON_TOKEN token = tree->getToken(tree);
+      // getText keeps the string in the token
+      if(token && token->textState == ANTLR3_TEXT_CHARP)
+        token->getText(token);
+    }
+
+    for(ANTLR3_UINT32 i = 0; i != tree->getChildCount(tree); ++i)
+      create_token_texts(static_cast<pANTLR3_BASE_TREE>(tree->getChild(tree, i)));
+  }
+
+  void use_locked_factory(pANTLR3_BASE_TREE ast)
+  {
+    // Make sure the pristine factory is created before walkers run
+    get_pristine_factory();
+    ast->strFactory->newRaw = &locked_newRaw8;
+    ast->strFactory->destroy = &locked_destroy;
   }
 }
 
-void bash_ast::init_parser(const std::string& script_path)
+void bash_ast::init_parser(const std::string& script_path, bool from_file)
 {
   input.reset(antlr3NewAsciiStringInPlaceStream(
     reinterpret_cast<pANTLR3_UINT8>(const_cast<char*>(script.c_str())),
@@ -104,6 +169,13 @@ void bash_ast::init_parser(const std::string& script_path)
       input->strFactory,
       reinterpret_cast<pANTLR3_UINT8>(const_cast<char*>(script_path.c_str())));
 
+  const std::string cache_path(from_file ? get_cache_path() : "");
+  if(!cache_path.empty() && load_cache(cache_path))
+  {
+    use_locked_factory(ast);
+    return;
+  }
+
   lexer.reset(libbashLexerNew(input.get()));
   if(!lexer)
     throw libbash::parse_exception("Unable to create the lexer due to malloc() failure");
@@ -116,12 +188,484 @@ void bash_ast::init_parser(const std::string& script_path)
   parser.reset(libbashParserNew(token_stream.get()));
   if(!parser)
     throw libbash::parse_exception("Out of memory trying to allocate parser");
+  parser->lazy_function_bodies = from_file && lazy_function_bodies();
 
   ast = parse(parser.get());
-  ast->strFactory->newRaw = &locked_newRaw8;
-  ast->strFactory->destroy = &locked_destroy;
+  use_locked_factory(ast);
   if(parser->pParser->rec->getNumberOfSyntaxErrors(parser->pParser->rec))
     throw libbash::parse_exception("Something wrong happened while parsing");
+
+  if(!cache_path.empty())
+    save_cache(cache_path);
+}
+
+namespace
+{
+  std::string& cache_directory()
+  {
+    static std::string directory(getenv("LIBBASH_AST_CACHE_DIR") ? getenv("LIBBASH_AST_CACHE_DIR") : "");
+    return directory;
+  }
+
+  // Bump this when the layout below or the way nodes are rebuilt changes.
+  // Changes to the grammar are covered by LIBBASH_GRAMMAR_STAMP.
+  const uint32_t cache_format_version = 3;
+  const char cache_magic[8] = {'L', 'I', 'B', 'B', 'A', 'S', 'H', '\0'};
+
+  // A cache file contains the header, the script padded to 8 bytes, the
+  // nodes in preorder and the pool of node texts. Texts are referred to by
+  // offsets so the file can be mapped anywhere.
+  struct cache_header
+  {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t lazy_function_bodies;
+    char grammar_stamp[32];
+    uint64_t script_size;
+    uint64_t node_count;
+    uint64_t text_size;
+  };
+
+  // flags of cache nodes
+  const uint32_t NIL_NODE = 1;
+  // the text of the token is a range of the script
+  const uint32_t RANGE_TEXT = 2;
+  // the text of the token is in the text pool
+  const uint32_t POOL_TEXT = 4;
+  // the token of a POOL_TEXT node also spans a range of the script
+  const uint32_t SCRIPT_SPAN = 8;
+
+  struct cache_node
+  {
+    uint32_t type;
+    uint32_t flags;
+    uint32_t child_count;
+    uint32_t text_offset;
+    int64_t start;
+    int64_t stop;
+    uint32_t line;
+    int32_t char_position;
+  };
+
+  uint64_t padded_size(uint64_t size)
+  {
+    return (size + 7) & ~static_cast<uint64_t>(7);
+  }
+
+  void serialize_tree(pANTLR3_BASE_TREE tree,
+                      const std::string& script,
+                      std::vector<cache_node>& nodes,
+                      std::string& texts)
+  {
+    cache_node node = cache_node();
+    node.child_count = tree->getChildCount(tree);
+
+    if(tree->isNilNode(tree))
+    {
+      node.flags = NIL_NODE;
+    }
+    else
+    {
+      pANTLR3_COMMON_TOKEN token = tree->getToken(tree);
+      node.type = tree->getType(tree);
+      node.line = token->getLine(token);
+      node.char_position = token->getCharPositionInLine(token);
+
+      // Tokens from the lexer refer to the script by pointers
+      const ANTLR3_MARKER begin = reinterpret_cast<ANTLR3_MARKER>(script.c_str());
+      const ANTLR3_MARKER end = begin + boost::numeric_cast<ANTLR3_MARKER>(script.size());
+      if(token->textState == ANTLR3_TEXT_NONE && token->start >= begin && token->stop < end)
+      {
+        node.flags = RANGE_TEXT;
+        node.start = token->start - begin;
+        node.stop = token->stop - begin;
+      }
+      else
+      {
+        node.flags = POOL_TEXT;
+        // The walker reads the span of some tokens whose text was replaced
+        if(token->start >= begin && token->stop < end)
+        {
+          node.flags |= SCRIPT_SPAN;
+          node.start = token->start - begin;
+          node.stop = token->stop - begin;
+        }
+        node.text_offset = boost::numeric_cast<uint32_t>(texts.size());
+        pANTLR3_STRING text = token->getText(token);
+        if(text && text->chars)
+          texts.append(reinterpret_cast<char*>(text->chars), text->len);
+        texts.push_back('\0');
+      }
+    }
+    nodes.push_back(node);
+
+    for(ANTLR3_UINT32 i = 0; i != node.child_count; ++i)
+      serialize_tree(static_cast<pANTLR3_BASE_TREE>(tree->getChild(tree, i)), script, nodes, texts);
+  }
+
+  struct tree_builder
+  {
+    pANTLR3_BASE_TREE_ADAPTOR adaptor;
+    pANTLR3_INPUT_STREAM input;
+    const char* script;
+    uint64_t script_size;
+    const cache_node* nodes;
+    uint64_t node_count;
+    const char* texts;
+    uint64_t text_size;
+    uint64_t next;
+
+    // Empty tokens stop right before their start
+    bool valid_span(const cache_node& node) const
+    {
+      const int64_t size = static_cast<int64_t>(script_size);
+      return node.start >= 0 && node.start <= size
+             && node.stop >= node.start - 1 && node.stop < size;
+    }
+
+    // The walker relies on DOWN, UP and EOF to navigate the tree
+    bool valid_type(const cache_node& node) const
+    {
+      return node.type >= ANTLR3_MIN_TOKEN_TYPE && node.type != ANTLR3_TOKEN_EOF;
+    }
+
+    // Return null if the nodes are inconsistent
+    void* build()
+    {
+      if(next == node_count)
+        return 0;
+      const cache_node& node = nodes[next++];
+      if(node.child_count > node_count - next)
+        return 0;
+
+      void* tree;
+      if(node.flags == NIL_NODE)
+      {
+        tree = adaptor->nilNode(adaptor);
+      }
+      else if(!valid_type(node))
+      {
+        return 0;
+      }
+      else if(node.flags == RANGE_TEXT && valid_span(node))
+      {
+        pANTLR3_COMMON_TOKEN token = adaptor->createToken(adaptor, node.type, NULL);
+        token->textState = ANTLR3_TEXT_NONE;
+        token->input = input;
+        token->start = reinterpret_cast<ANTLR3_MARKER>(script + node.start);
+        token->stop = reinterpret_cast<ANTLR3_MARKER>(script + node.stop);
+        token->setLine(token, node.line);
+        token->setCharPositionInLine(token, node.char_position);
+        tree = adaptor->create(adaptor, token);
+      }
+      else if((node.flags & ~SCRIPT_SPAN) == POOL_TEXT && node.text_offset < text_size
+              && (!(node.flags & SCRIPT_SPAN) || valid_span(node)))
+      {
+        // The text pool lives as long as the mapping
+        pANTLR3_COMMON_TOKEN token = adaptor->createToken(
+            adaptor,
+            node.type,
+            reinterpret_cast<pANTLR3_UINT8>(const_cast<char*>(texts + node.text_offset)));
+        if(node.flags & SCRIPT_SPAN)
+        {
+          token->input = input;
+          token->start = reinterpret_cast<ANTLR3_MARKER>(script + node.start);
+          token->stop = reinterpret_cast<ANTLR3_MARKER>(script + node.stop);
+        }
+        token->setLine(token, node.line);
+        token->setCharPositionInLine(token, node.char_position);
+        tree = adaptor->create(adaptor, token);
+      }
+      else
+      {
+        return 0;
+      }
+
+      for(uint32_t i = 0; i != node.child_count; ++i)
+      {
+        void* child = build();
+        if(!child)
+          return 0;
+        adaptor->addChild(adaptor, tree, child);
+      }
+      return tree;
+    }
+  };
+}
+
+void bash_ast::set_cache_directory(const std::string& directory)
+{
+  cache_directory() = directory;
+}
+
+void bash_ast::set_lazy_function_bodies(bool lazy)
+{
+  lazy_function_bodies() = lazy;
+}
+
+std::string bash_ast::get_cache_path() const
+{
+  typedef pANTLR3_BASE_TREE (*parser_rule)(plibbashParser);
+  const parser_rule* rule = parse.target<parser_rule>();
+  if(cache_directory().empty() || !rule || *rule != &parser_start)
+    return "";
+
+  // FNV-1a, the script itself is compared when the cache is loaded. Lazy
+  // function bodies produce a different AST so they use another seed.
+  uint64_t hash = lazy_function_bodies() ? 1099511628211ULL : 14695981039346656037ULL;
+  for(auto iter = script.begin(); iter != script.end(); ++iter)
+  {
+    hash ^= static_cast<unsigned char>(*iter);
+    hash *= 1099511628211ULL;
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.ast", static_cast<unsigned long long>(hash));
+  return cache_directory() + "/" + name;
+}
+
+bool bash_ast::load_cache(const std::string& cache_path)
+{
+  int fd = open(cache_path.c_str(), O_RDONLY);
+  if(fd == -1)
+    return false;
+
+  struct stat status;
+  if(fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(cache_header)))
+  {
+    close(fd);
+    return false;
+  }
+  const size_t size = boost::numeric_cast<size_t>(status.st_size);
+  void* mapping = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(mapping == MAP_FAILED)
+    return false;
+  std::shared_ptr<void> mapping_holder(mapping, [size](void* p) { munmap(p, size); });
+
+  const char* data = static_cast<const char*>(mapping);
+  const cache_header& header = *static_cast<const cache_header*>(mapping);
+  if(memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0
+     || header.format_version != cache_format_version
+     || header.lazy_function_bodies != lazy_function_bodies()
+     || strncmp(header.grammar_stamp, LIBBASH_GRAMMAR_STAMP, sizeof(header.grammar_stamp)) != 0
+     || header.script_size != script.size()
+     || header.node_count > size / sizeof(cache_node)
+     || header.text_size > size
+     || sizeof(cache_header) + padded_size(header.script_size)
+        + header.node_count * sizeof(cache_node) + header.text_size != size)
+    return false;
+
+  const char* cached_script = data + sizeof(cache_header);
+  if(memcmp(cached_script, script.c_str(), script.size()) != 0)
+    return false;
+
+  const char* texts = cached_script + padded_size(header.script_size) + header.node_count * sizeof(cache_node);
+  if(header.text_size != 0 && texts[header.text_size - 1] != '\0')
+    return false;
+
+  antlr_pointer<ANTLR3_BASE_TREE_ADAPTOR_struct> adaptor(ANTLR3_TREE_ADAPTORNew(input->strFactory));
+  if(!adaptor)
+    throw libbash::parse_exception("Out of memory trying to allocate tree adaptor");
+
+  tree_builder builder = {
+    adaptor.get(),
+    input.get(),
+    script.c_str(),
+    header.script_size,
+    reinterpret_cast<const cache_node*>(cached_script + padded_size(header.script_size)),
+    header.node_count,
+    texts,
+    header.text_size,
+    0
+  };
+  void* root = builder.build();
+  if(!root || builder.next != header.node_count)
+    return false;
+
+  ast = static_cast<pANTLR3_BASE_TREE>(root);
+  cache_mapping = mapping_holder;
+  cache_adaptor = std::move(adaptor);
+  return true;
+}
+
+void bash_ast::save_cache(const std::string& cache_path) const
+{
+  std::vector<cache_node> nodes;
+  std::string texts;
+  serialize_tree(ast, script, nodes, texts);
+
+  cache_header header = cache_header();
+  memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.format_version = cache_format_version;
+  header.lazy_function_bodies = lazy_function_bodies();
+  memcpy(header.grammar_stamp, LIBBASH_GRAMMAR_STAMP, sizeof(header.grammar_stamp));
+  header.script_size = script.size();
+  header.node_count = nodes.size();
+  header.text_size = texts.size();
+
+  // Write to a private file and rename it so that other processes never
+  // see a partial cache file. Failing to write the cache is not an error.
+  std::stringstream temp_path;
+  temp_path << cache_path << "." << getpid() << "." << std::this_thread::get_id();
+  {
+    std::ofstream output(temp_path.str(), std::ios::binary);
+    if(!output)
+      return;
+
+    const char padding[8] = {};
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(script.c_str(), boost::numeric_cast<std::streamsize>(script.size()));
+    output.write(padding, boost::numeric_cast<std::streamsize>(padded_size(script.size()) - script.size()));
+    if(!nodes.empty())
+      output.write(reinterpret_cast<const char*>(&nodes[0]),
+                   boost::numeric_cast<std::streamsize>(nodes.size() * sizeof(cache_node)));
+    output.write(texts.c_str(), boost::numeric_cast<std::streamsize>(texts.size()));
+    if(!output)
+    {
+      output.close();
+      unlink(temp_path.str().c_str());
+      return;
+    }
+  }
+
+  if(rename(temp_path.str().c_str(), cache_path.c_str()) != 0)
+    unlink(temp_path.str().c_str());
+}
+
+std::shared_ptr<bash_ast> bash_ast::get_nested_ast(pANTLR3_BASE_TREE node,
+                                                   const std::string& text,
+                                                   std::function<pANTLR3_BASE_TREE(plibbashParser)> p,
+                                                   bool trim)
+{
+  {
+    std::lock_guard<std::mutex> l(nested_ast_mutex);
+    auto iter = nested_asts.find(node);
+    if(iter != nested_asts.end())
+      return iter->second;
+  }
+
+  // Parse without holding the lock so that other nodes can be served
+  // meanwhile. This may throw exception, nothing will be cached then.
+  std::shared_ptr<bash_ast> result(new bash_ast(std::stringstream(text), p, trim));
+
+  std::lock_guard<std::mutex> l(nested_ast_mutex);
+  // Another thread may have built the same AST, keep the first one
+  return nested_asts.insert(std::make_pair(node, result)).first->second;
+}
+
+std::shared_ptr<const glob_pattern> bash_ast::get_static_pattern(pANTLR3_BASE_TREE node)
+{
+  std::lock_guard<std::mutex> l(static_pattern_mutex);
+  auto iter = static_patterns.find(node);
+  return iter == static_patterns.end() ? std::shared_ptr<const glob_pattern>() : iter->second;
+}
+
+std::shared_ptr<const glob_pattern> bash_ast::add_static_pattern(pANTLR3_BASE_TREE node,
+                                                                 const std::shared_ptr<const glob_pattern>& pattern)
+{
+  std::lock_guard<std::mutex> l(static_pattern_mutex);
+  return static_patterns.insert(std::make_pair(node, pattern)).first->second;
+}
+
+std::shared_ptr<const glob_pattern_set> bash_ast::get_case_patterns(pANTLR3_BASE_TREE node)
+{
+  std::lock_guard<std::mutex> l(static_pattern_mutex);
+  auto iter = case_patterns.find(node);
+  return iter == case_patterns.end() ? std::shared_ptr<const glob_pattern_set>() : iter->second;
+}
+
+std::shared_ptr<const glob_pattern_set> bash_ast::add_case_patterns(pANTLR3_BASE_TREE node,
+                                                                    const std::shared_ptr<const glob_pattern_set>& patterns)
+{
+  std::lock_guard<std::mutex> l(static_pattern_mutex);
+  return case_patterns.insert(std::make_pair(node, patterns)).first->second;
+}
+
+std::shared_ptr<bash_ast> bash_ast::get_function_body(pANTLR3_BASE_TREE lazy_body)
+{
+  // The braces point into the script
+  pANTLR3_BASE_TREE left_brace = static_cast<pANTLR3_BASE_TREE>(lazy_body->getChild(lazy_body, 0));
+  pANTLR3_BASE_TREE right_brace = static_cast<pANTLR3_BASE_TREE>(lazy_body->getChild(lazy_body, 1));
+  const char* begin = reinterpret_cast<const char*>(left_brace->getToken(left_brace)->start);
+  const char* end = reinterpret_cast<const char*>(right_brace->getToken(right_brace)->stop) + 1;
+
+  return get_nested_ast(lazy_body, std::string(begin, end), &bash_ast::parser_compound_command);
+}
+
+void bash_ast::build_subtree_ends()
+{
+  node_stream_pointer nodes = acquire_node_stream();
+  pANTLR3_INT_STREAM istream = nodes->tnstream->istream;
+  auto istream_size = istream->size(istream);
+
+  subtree_ends.assign(istream_size, 0);
+  std::vector<ANTLR3_MARKER> roots;
+  // LA(i) refers to the node at index i - 1
+  for(ANTLR3_UINT32 i = 1; i <= istream_size; ++i)
+  {
+    ANTLR3_UINT32 token = istream->_LA(istream, boost::numeric_cast<ANTLR3_INT32>(i));
+    if(token == ANTLR3_TOKEN_DOWN)
+    {
+      roots.push_back(i - 2);
+    }
+    else if(token == ANTLR3_TOKEN_UP)
+    {
+      subtree_ends[boost::numeric_cast<std::vector<ANTLR3_MARKER>::size_type>(roots.back())] = i;
+      roots.pop_back();
+    }
+  }
+}
+
+ANTLR3_MARKER bash_ast::get_subtree_end(ANTLR3_MARKER index)
+{
+  std::call_once(subtree_ends_flag, &bash_ast::build_subtree_ends, this);
+
+  auto position = boost::numeric_cast<std::vector<ANTLR3_MARKER>::size_type>(index);
+  if(position >= subtree_ends.size() || subtree_ends[position] == 0)
+    return index + 1;
+  return subtree_ends[position];
+}
+
+void bash_ast::build_symbol_ids()
+{
+  node_stream_pointer nodes = acquire_node_stream();
+  pANTLR3_INT_STREAM istream = nodes->tnstream->istream;
+  auto istream_size = istream->size(istream);
+
+  symbol_ids.assign(istream_size, symbol_id::unknown_symbol);
+  // LA(i) refers to the node at index i - 1
+  for(ANTLR3_UINT32 i = 1; i <= istream_size; ++i)
+  {
+    ANTLR3_UINT32 token_type = istream->_LA(istream, boost::numeric_cast<ANTLR3_INT32>(i));
+    if(token_type != NAME && token_type != LETTER)
+      continue;
+
+    pANTLR3_BASE_TREE node = static_cast<pANTLR3_BASE_TREE>(
+        nodes->tnstream->_LT(nodes->tnstream, boost::numeric_cast<ANTLR3_INT32>(i)));
+    pANTLR3_COMMON_TOKEN token = node->getToken(node);
+    if(token && token->start)
+      symbol_ids[i - 1] = get_symbol_id(std::string(reinterpret_cast<const char*>(token->start),
+                                                    boost::numeric_cast<unsigned>(token->stop - token->start + 1)));
+  }
+}
+
+void bash_ast::build_token_texts()
+{
+  pANTLR3_STRING_FACTORY* enclosing_factory = walker_factory;
+  walker_factory = 0;
+  create_token_texts(ast);
+  walker_factory = enclosing_factory;
+}
+
+unsigned bash_ast::resolve_symbol_id(ANTLR3_MARKER index, const std::string& name)
+{
+  std::call_once(symbol_ids_flag, &bash_ast::build_symbol_ids, this);
+
+  auto position = boost::numeric_cast<std::vector<unsigned>::size_type>(index);
+  if(position < symbol_ids.size() && symbol_ids[position] != symbol_id::unknown_symbol)
+    return symbol_ids[position];
+  return get_symbol_id(name);
 }
 
 std::string bash_ast::get_dot_graph()
@@ -227,6 +771,11 @@ std::string bash_ast::walker_string_expr(libbashWalker_Ctx_struct* tree_parser)
   return tree_parser->string_expr(tree_parser).libbash_value;
 }
 
+std::string bash_ast::walker_regex_expr(libbashWalker_Ctx_struct* tree_parser)
+{
+  return tree_parser->regex_expr(tree_parser);
+}
+
 pANTLR3_BASE_TREE bash_ast::parser_start(plibbashParser parser)
 {
   return parser->start(parser).tree;
@@ -237,6 +786,11 @@ pANTLR3_BASE_TREE bash_ast::parser_arithmetics(plibbashParser parser)
   return parser->arithmetics(parser).tree;
 }
 
+pANTLR3_BASE_TREE bash_ast::parser_compound_command(libbashParser_Ctx_struct* parser)
+{
+  return parser->compound_command(parser).tree;
+}
+
 pANTLR3_BASE_TREE bash_ast::parser_all_expansions(libbashParser_Ctx_struct* parser)
 {
   return parser->all_expansions(parser).tree;
@@ -263,17 +817,61 @@ void bash_ast::call_function(plibbashWalker ctx,
   ctx->compound_command(ctx);
 }
 
+bash_ast::node_stream_pointer bash_ast::acquire_node_stream()
+{
+  auto release = [&](pANTLR3_COMMON_TREE_NODE_STREAM nodes)
+  {
+    // Rewind the stream and keep the node buffer for the next walker
+    nodes->reset(nodes);
+    std::lock_guard<std::mutex> l(node_stream_mutex);
+    idle_node_streams.push_back(nodes);
+  };
+
+  {
+    std::lock_guard<std::mutex> l(node_stream_mutex);
+    if(!idle_node_streams.empty())
+    {
+      pANTLR3_COMMON_TREE_NODE_STREAM nodes = idle_node_streams.back();
+      idle_node_streams.pop_back();
+      return node_stream_pointer(nodes, release);
+    }
+  }
+
+  // Recursive function calls and other threads may need more than one stream
+  pANTLR3_COMMON_TREE_NODE_STREAM nodes = antlr3CommonTreeNodeStreamNewTree(ast, ANTLR3_SIZE_HINT);
+  if(!nodes)
+    throw libbash::runtime_exception("Out of memory trying to allocate tree node stream");
+  return node_stream_pointer(nodes, release);
+}
+
 bash_ast::walker_pointer bash_ast::create_walker(interpreter& walker,
-                                                 antlr_pointer<ANTLR3_COMMON_TREE_NODE_STREAM_struct>& nodes)
+                                                 pANTLR3_COMMON_TREE_NODE_STREAM nodes)
 {
+    std::call_once(token_texts_flag, &bash_ast::build_token_texts, this);
+
     set_interpreter(&walker);
     walker.push_current_ast(this);
 
-    auto deleter = [&](plibbashWalker tree_parser)
+    plibbashWalker tree_parser = libbashWalkerNew(nodes);
+    if(!tree_parser)
+    {
+      walker.pop_current_ast();
+      throw libbash::runtime_exception("Out of memory trying to allocate tree parser");
+    }
+
+    // The factory is created on the first string of the walker
+    std::shared_ptr<pANTLR3_STRING_FACTORY> strings(new pANTLR3_STRING_FACTORY(0));
+    pANTLR3_STRING_FACTORY* enclosing_factory = walker_factory;
+    walker_factory = strings.get();
+
+    auto deleter = [&walker, strings, enclosing_factory](plibbashWalker tree_parser)
     {
       tree_parser->free(tree_parser);
+      if(*strings)
+        (*strings)->close(*strings);
+      walker_factory = enclosing_factory;
       walker.pop_current_ast();
     };
 
-    return walker_pointer(libbashWalkerNew(nodes.get()), deleter);
+    return walker_pointer(tree_parser, deleter);
 }
@@ -28,7 +28,9 @@
 #include <functional>
 #include <istream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <antlr3.h>
@@ -37,6 +39,8 @@
 struct libbashLexer_Ctx_struct;
 struct libbashParser_Ctx_struct;
 struct libbashWalker_Ctx_struct;
+class glob_pattern;
+class glob_pattern_set;
 class interpreter;
 
 /// \class antlr_pointer
@@ -65,12 +69,63 @@ class bash_ast: public boost::noncopyable
   pANTLR3_BASE_TREE ast;
   std::function<pANTLR3_BASE_TREE(libbashParser_Ctx_struct*)> parse;
 
+  /// \brief the memory mapped cache file and the tree adaptor that owns the
+  ///        nodes, only used when the AST is loaded from the AST cache
+  std::shared_ptr<void> cache_mapping;
+  antlr_pointer<ANTLR3_BASE_TREE_ADAPTOR_struct> cache_adaptor;
+
+  /// \brief ASTs built from the text of nodes in this AST, such as the word
+  ///        of ${var:-word}. They are built once and reused afterwards.
+  std::unordered_map<pANTLR3_BASE_TREE, std::shared_ptr<bash_ast>> nested_asts;
+  std::mutex nested_ast_mutex;
+
+  /// \brief compiled patterns that don't contain expansions, indexed by
+  ///        the first node of the pattern
+  std::unordered_map<pANTLR3_BASE_TREE, std::shared_ptr<const glob_pattern>> static_patterns;
+
+  /// \brief the compiled clauses of case statements, indexed by the CASE node
+  std::unordered_map<pANTLR3_BASE_TREE, std::shared_ptr<const glob_pattern_set>> case_patterns;
+  /// \brief guards static_patterns and case_patterns
+  std::mutex static_pattern_mutex;
+
+  /// \brief node streams that have been used by finished walkers. The tree
+  ///        is linearized into a node buffer when a stream is first used.
+  ///        Reusing the streams avoids doing that for every function call.
+  std::vector<pANTLR3_COMMON_TREE_NODE_STREAM> idle_node_streams;
+  std::mutex node_stream_mutex;
+
+  /// \brief the node index right after each subtree, indexed by the node
+  ///        index of the subtree root
+  std::vector<ANTLR3_MARKER> subtree_ends;
+  std::once_flag subtree_ends_flag;
+
+  void build_subtree_ends();
+
+  /// \brief the symbol ids of the variable names in the AST, indexed by
+  ///        the node index of the NAME and LETTER nodes
+  std::vector<unsigned> symbol_ids;
+  std::once_flag symbol_ids_flag;
+
+  void build_symbol_ids();
+
+  /// \brief the ANTLR runtime keeps the texts of tokens in the tokens, so
+  ///        they are created before the first walker runs
+  std::once_flag token_texts_flag;
+
+  void build_token_texts();
+
   typedef std::unique_ptr<libbashWalker_Ctx_struct, std::function<void(libbashWalker_Ctx_struct*)>> walker_pointer;
+  typedef std::unique_ptr<ANTLR3_COMMON_TREE_NODE_STREAM_struct,
+                          std::function<void(pANTLR3_COMMON_TREE_NODE_STREAM)>> node_stream_pointer;
 
   void read_script(const std::istream& source, bool trim);
-  void init_parser(const std::string& script_path);
+  void init_parser(const std::string& script_path, bool from_file);
+  std::string get_cache_path() const;
+  bool load_cache(const std::string& cache_path);
+  void save_cache(const std::string& cache_path) const;
+  node_stream_pointer acquire_node_stream();
   walker_pointer create_walker(interpreter& walker,
-                               antlr_pointer<ANTLR3_COMMON_TREE_NODE_STREAM_struct>& nodes);
+                               pANTLR3_COMMON_TREE_NODE_STREAM nodes);
 
 public:
   /// \brief build AST from istream
@@ -85,6 +140,84 @@ public:
   bash_ast(const std::string& script_path,
            std::function<pANTLR3_BASE_TREE(libbashParser_Ctx_struct*)> p=parser_start, bool trim=true);
 
+  /// \brief the destructor
+  ~bash_ast();
+
+  /// \brief set the directory of the on-disk AST cache. Scripts that are
+  ///        read from files with the start rule are cached there and loaded
+  ///        instead of being parsed again. The cache is keyed by the script
+  ///        content and stamped with the grammar version. The default value
+  ///        comes from the LIBBASH_AST_CACHE_DIR environment variable. This
+  ///        is not thread safe, set it before interpreting any script.
+  /// \param directory the cache directory, empty to disable the cache
+  static void set_cache_directory(const std::string& directory);
+
+  /// \brief set whether the bodies of functions defined in scripts read from
+  ///        files are parsed only when the functions are called. Syntax
+  ///        errors in the bodies are reported on the first call then. This
+  ///        is not thread safe, set it before interpreting any script.
+  /// \param lazy whether to parse function bodies lazily
+  static void set_lazy_function_bodies(bool lazy);
+
+  /// \brief get the AST of a function body that is not parsed yet. The AST
+  ///        is built on the first request and cached for later requests.
+  /// \param lazy_body the LAZY_FUNCTION_BODY node
+  /// \return the AST whose root is the compound command of the body
+  std::shared_ptr<bash_ast> get_function_body(pANTLR3_BASE_TREE lazy_body);
+
+  /// \brief get the AST built from the text of a node in this AST. The AST
+  ///        is built on the first request and cached for later requests.
+  /// \param node the node that the text belongs to
+  /// \param text the text to be parsed
+  /// \param p the parser rule for building the AST
+  /// \param trim whether to trim the text
+  /// \return the cached AST
+  std::shared_ptr<bash_ast> get_nested_ast(pANTLR3_BASE_TREE node,
+                                           const std::string& text,
+                                           std::function<pANTLR3_BASE_TREE(libbashParser_Ctx_struct*)> p,
+                                           bool trim=true);
+
+  /// \brief get the compiled pattern cached for a pattern that doesn't
+  ///        contain expansions
+  /// \param node the first node of the pattern
+  /// \return the compiled pattern, null if it's not cached yet
+  std::shared_ptr<const glob_pattern> get_static_pattern(pANTLR3_BASE_TREE node);
+
+  /// \brief cache the compiled pattern for a pattern that doesn't contain
+  ///        expansions
+  /// \param node the first node of the pattern
+  /// \param pattern the compiled pattern
+  /// \return the cached pattern, it's the one cached first if several
+  ///         threads compile the same pattern
+  std::shared_ptr<const glob_pattern> add_static_pattern(pANTLR3_BASE_TREE node,
+                                                         const std::shared_ptr<const glob_pattern>& pattern);
+
+  /// \brief get the compiled clauses of a case statement
+  /// \param node the CASE node
+  /// \return the compiled clauses, null if they are not cached yet
+  std::shared_ptr<const glob_pattern_set> get_case_patterns(pANTLR3_BASE_TREE node);
+
+  /// \brief cache the compiled clauses of a case statement
+  /// \param node the CASE node
+  /// \param patterns the compiled clauses
+  /// \return the cached clauses, it's the one cached first if several
+  ///         threads compile the same statement
+  std::shared_ptr<const glob_pattern_set> add_case_patterns(pANTLR3_BASE_TREE node,
+                                                            const std::shared_ptr<const glob_pattern_set>& patterns);
+
+  /// \brief get the node index right after the subtree that starts at the
+  ///        given index. The index table is built once for the AST.
+  /// \param index the node index of the subtree root
+  /// \return the node index after the subtree, index + 1 if the node is a leaf
+  ANTLR3_MARKER get_subtree_end(ANTLR3_MARKER index);
+
+  /// \brief get the symbol id of a variable name in the AST. The names of
+  ///        the AST are interned together the first time.
+  /// \param index the node index of the name
+  /// \param name the text of the name, interned if the node is not a name
+  /// \return the symbol id of the name
+  unsigned resolve_symbol_id(ANTLR3_MARKER index, const std::string& name);
+
   /// \brief the functor for walker start rule
   /// \param tree_parser the pointer to the tree_parser
   static void walker_start(libbashWalker_Ctx_struct* tree_parser);
@@ -97,6 +230,10 @@ public:
   /// \param tree_parser the pointer to the tree_parser
   static std::string walker_string_expr(libbashWalker_Ctx_struct* tree_parser);
 
+  /// \brief the functor for walker regex_expr rule
+  /// \param tree_parser the pointer to the tree_parser
+  static std::string walker_regex_expr(libbashWalker_Ctx_struct* tree_parser);
+
   /// \brief call a function that is defined in the AST
   /// \param tree_parser the pointer to the tree_parser
   /// \param index the function index
@@ -111,6 +248,10 @@ public:
   /// \param parser the pointer to the parser
   static pANTLR3_BASE_TREE parser_arithmetics(libbashParser_Ctx_struct* parser);
 
+  /// \brief the functor for parser compound_command rule
+  /// \param parser the pointer to the parser
+  static pANTLR3_BASE_TREE parser_compound_command(libbashParser_Ctx_struct* parser);
+
   /// \brief the functor for parser all_expansions rule
   /// \param parser the pointer to the parser
   static pANTLR3_BASE_TREE parser_all_expansions(libbashParser_Ctx_struct* parser);
@@ -129,9 +270,8 @@ public:
   typename std::result_of<Functor(libbashWalker_Ctx_struct*)>::type
   interpret_with(interpreter& walker, Functor walk)
   {
-    antlr_pointer<ANTLR3_COMMON_TREE_NODE_STREAM_struct> nodes(
-      antlr3CommonTreeNodeStreamNewTree(ast, ANTLR3_SIZE_HINT));
-    walker_pointer p_tree_parser = create_walker(walker, nodes);
+    node_stream_pointer nodes = acquire_node_stream();
+    walker_pointer p_tree_parser = create_walker(walker, nodes.get());
     return walk(p_tree_parser.get());
   }
 
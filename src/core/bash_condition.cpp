@@ -32,19 +32,114 @@
 #include "core/interpreter.h"
 #include "exceptions.h"
 
+int file_status_cache::get_stat(const std::string& path, struct stat& info)
+{
+  std::lock_guard<std::mutex> l(status_mutex);
+  file_status& status = statuses[path];
+  if(status.stat_known)
+  {
+    ++hits;
+  }
+  else
+  {
+    ++misses;
+    status.stat_result = stat(path.c_str(), &status.stat_info);
+    status.stat_known = true;
+  }
+  info = status.stat_info;
+  return status.stat_result;
+}
+
+int file_status_cache::get_lstat(const std::string& path, struct stat& info)
+{
+  std::lock_guard<std::mutex> l(status_mutex);
+  file_status& status = statuses[path];
+  if(status.lstat_known)
+  {
+    ++hits;
+  }
+  else
+  {
+    ++misses;
+    status.lstat_result = lstat(path.c_str(), &status.lstat_info);
+    status.lstat_known = true;
+  }
+  info = status.lstat_info;
+  return status.lstat_result;
+}
+
+int file_status_cache::get_access(const std::string& path, int mode)
+{
+  // F_OK or any combination of R_OK, W_OK and X_OK
+  mode &= 7;
+  const std::size_t index = static_cast<std::size_t>(mode);
+  std::lock_guard<std::mutex> l(status_mutex);
+  file_status& status = statuses[path];
+  if(status.access_known[index])
+  {
+    ++hits;
+  }
+  else
+  {
+    ++misses;
+    status.access_granted[index] = access(path.c_str(), mode) == 0;
+    status.access_known[index] = true;
+  }
+  return status.access_granted[index] ? 0 : -1;
+}
+
+void file_status_cache::invalidate(const std::string& path)
+{
+  // Writing a file changes the modification time of its directory as well
+  auto pos = path.find_last_of('/');
+  std::string directory = (pos == std::string::npos ? "." : path.substr(0, pos == 0 ? 1 : pos));
+
+  std::lock_guard<std::mutex> l(status_mutex);
+  statuses.erase(path);
+  statuses.erase(directory);
+}
+
+void file_status_cache::clear()
+{
+  std::lock_guard<std::mutex> l(status_mutex);
+  statuses.clear();
+}
+
+unsigned long file_status_cache::get_hits() const
+{
+  std::lock_guard<std::mutex> l(status_mutex);
+  return hits;
+}
+
+unsigned long file_status_cache::get_misses() const
+{
+  std::lock_guard<std::mutex> l(status_mutex);
+  return misses;
+}
+
 namespace
 {
-  bool test_file_stat(char op, const std::string& path)
+  int get_stat(const std::string& path, struct stat& info, file_status_cache* cache)
+  {
+    return cache ? cache->get_stat(path, info) : stat(path.c_str(), &info);
+  }
+
+  int get_access(const std::string& path, int mode, file_status_cache* cache)
+  {
+    return cache ? cache->get_access(path, mode) : access(path.c_str(), mode);
+  }
+
+  bool test_file_stat(char op, const std::string& path, file_status_cache* cache)
   {
     struct stat info;
     int status = 0;
 
     // symbol link use lstat so we need to separate this.
     if(op == 'L' || op == 'h')
-      return lstat(path.c_str(), &info) == 0 && S_ISLNK(info.st_mode);
+      return (cache ? cache->get_lstat(path, info) : lstat(path.c_str(), &info)) == 0 && S_ISLNK(info.st_mode);
 
-    status = stat(path.c_str(), &info);
-    if(status != 0 || access(path.c_str(), F_OK))
+    status = get_stat(path, info, cache);
+    if(status != 0 || get_access(path, F_OK, cache))
       return false;
 
     switch(op)
@@ -67,15 +162,15 @@ namespace
       case 'p':
         return S_ISFIFO(info.st_mode);
       case 'r':
-        return access(path.c_str(), R_OK) == 0;
+        return get_access(path, R_OK, cache) == 0;
       case 's':
         return info.st_size > 0;
       case 'u':
         return S_ISUID & info.st_mode;
       case 'w':
-        return access(path.c_str(), W_OK) == 0;
+        return get_access(path, W_OK, cache) == 0;
       case 'x':
-        return access(path.c_str(), X_OK) == 0;
+        return get_access(path, X_OK, cache) == 0;
       case 'O':
         return geteuid() == info.st_uid;
       case 'G':
@@ -90,7 +185,7 @@ namespace
   }
 }
 
-bool internal::test_unary(char op, const std::string& target)
+bool internal::test_unary(char op, const std::string& target, file_status_cache* cache)
 {
   switch(op)
   {
@@ -111,7 +206,7 @@ bool internal::test_unary(char op, const std::string& target)
         return false;
       }
     default:
-      return test_file_stat(op, target);
+      return test_file_stat(op, target, cache);
   }
 }
 
@@ -119,13 +214,14 @@ namespace
 {
   bool file_comp(char op,
                  const std::string& lhs,
-                 const std::string& rhs)
+                 const std::string& rhs,
+                 file_status_cache* cache)
   {
     struct stat lst, rst;
     int lstatus, rstatus;
 
-    lstatus = stat(lhs.c_str(), &lst);
-    rstatus = stat(rhs.c_str(), &rst);
+    lstatus = get_stat(lhs, lst, cache);
+    rstatus = get_stat(rhs, rst, cache);
     if(op == 'e' && (lstatus < 0 || rstatus < 0))
       return false;
 
@@ -157,11 +253,11 @@ bool internal::test_binary(const std::string& op,
   try
   {
     if(op == "nt")
-      return file_comp('n', lhs, rhs);
+      return file_comp('n', lhs, rhs, walker.get_file_status_cache());
     else if(op == "ot")
-      return file_comp('o', lhs, rhs);
+      return file_comp('o', lhs, rhs, walker.get_file_status_cache());
     else if(op == "ef")
-      return file_comp('e', lhs, rhs);
+      return file_comp('e', lhs, rhs, walker.get_file_status_cache());
     // We do not support arithmetic expressions inside keyword test for now.
     // So the operands can only be raw integers.
     else if(op == "eq")
@@ -23,16 +23,91 @@
 #ifndef LIBBASH_CORE_BASH_CONDITION_H_
 #define LIBBASH_CORE_BASH_CONDITION_H_
 
+#include <bitset>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+
+#include <sys/stat.h>
 
 class interpreter;
 
+///
+/// \class file_status_cache
+/// \brief the results of stat, lstat and access used by the file test
+///        operators, keyed by the path as written in the script. It is
+///        meant for runs where the file system doesn't change underneath
+///        the interpreter, such as metadata generation. Files written by the
+///        interpreter through redirection are invalidated. A cache can be
+///        shared by several interpreters and threads.
+///
+class file_status_cache
+{
+  struct file_status
+  {
+    bool stat_known;
+    int stat_result;
+    struct stat stat_info;
+    bool lstat_known;
+    int lstat_result;
+    struct stat lstat_info;
+    /// \brief the access modes that have been checked, indexed by mode
+    std::bitset<8> access_known;
+    /// \brief whether the checked access modes are granted
+    std::bitset<8> access_granted;
+
+    file_status(): stat_known(false), lstat_known(false) {}
+  };
+
+  std::unordered_map<std::string, file_status> statuses;
+  mutable std::mutex status_mutex;
+  unsigned long hits;
+  unsigned long misses;
+
+public:
+  file_status_cache(): hits(0), misses(0) {}
+
+  /// \brief stat a file like stat(2)
+  /// \param path the path of the file
+  /// \param[out] info the status of the file
+  /// \return 0 on success, -1 on failure
+  int get_stat(const std::string& path, struct stat& info);
+
+  /// \brief stat a file without following symbolic links like lstat(2)
+  /// \param path the path of the file
+  /// \param[out] info the status of the file
+  /// \return 0 on success, -1 on failure
+  int get_lstat(const std::string& path, struct stat& info);
+
+  /// \brief check the permissions of a file like access(2)
+  /// \param path the path of the file
+  /// \param mode F_OK or a combination of R_OK, W_OK and X_OK
+  /// \return 0 on success, -1 on failure
+  int get_access(const std::string& path, int mode);
+
+  /// \brief forget the status of a file and of its directory
+  /// \param path the path of the file
+  void invalidate(const std::string& path);
+
+  /// \brief forget the status of all files
+  void clear();
+
+  /// \brief get the number of lookups answered from the cache
+  /// \return the number of hits
+  unsigned long get_hits() const;
+
+  /// \brief get the number of lookups that made a system call
+  /// \return the number of misses
+  unsigned long get_misses() const;
+};
+
 namespace internal
 {
   /// \brief implementation for built-in test unary operation
   /// \param the operator
   /// \param the operand
-  bool test_unary(char op, const std::string& target);
+  /// \param the cache of file status, null to query the file system
+  bool test_unary(char op, const std::string& target, file_status_cache* cache=0);
 
   /// \brief implementation for built-in test binary operation
   /// \param the operator
@@ -31,6 +31,16 @@
 
 void function::call(interpreter& walker)
 {
+  // The body is parsed on the first call and its AST starts with the body
+  if(lazy_body)
+  {
+    ast.get_function_body(lazy_body)->interpret_with(walker,
+                                                     std::bind(bash_ast::call_function,
+                                                               std::placeholders::_1,
+                                                               0));
+    return;
+  }
+
   ast.interpret_with(walker,
                      std::bind(bash_ast::call_function,
                                std::placeholders::_1,
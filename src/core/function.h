@@ -37,11 +37,17 @@ class function
 {
   bash_ast& ast;
   ANTLR3_MARKER index;
+  pANTLR3_BASE_TREE lazy_body;
 public:
   /// \brief the constructor
   /// \param ast_ the reference to the AST
   /// \param i the function index
-  function(bash_ast& ast_, ANTLR3_MARKER i): ast(ast_), index(i){}
+  function(bash_ast& ast_, ANTLR3_MARKER i): ast(ast_), index(i), lazy_body(0){}
+
+  /// \brief the constructor for a function whose body is not parsed yet
+  /// \param ast_ the reference to the AST
+  /// \param body the LAZY_FUNCTION_BODY node
+  function(bash_ast& ast_, pANTLR3_BASE_TREE body): ast(ast_), index(0), lazy_body(body){}
 
   /// \brief call the function
   /// \param walker the reference to the interpreter object
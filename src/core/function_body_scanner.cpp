@@ -0,0 +1,299 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+///
+/// \file function_body_scanner.cpp
+/// \brief implementation for the function body scanner
+///
+
+#include "core/function_body_scanner.h"
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  bool is_blank(char c)
+  {
+    return c == ' ' || c == '\t';
+  }
+
+  // Characters that end a word
+  bool is_delimiter(char c)
+  {
+    return c == '\0' || c == '\n' || is_blank(c) || strchr(";&|()<>", c);
+  }
+
+  // Reserved words that can be followed by a command or by the closing
+  // brace of a group
+  bool is_command_boundary(const std::string& word)
+  {
+    return word == "then" || word == "do" || word == "else" || word == "elif"
+      || word == "if" || word == "while" || word == "until" || word == "!" || word == "time"
+      || word == "done" || word == "fi" || word == "esac";
+  }
+
+  const char* skip_group(const char* p, char left, char right);
+
+  // All skip_* functions return the pointer to the closing character
+  const char* skip_single_quoted(const char* p)
+  {
+    const char* end = strchr(p + 1, '\'');
+    return end;
+  }
+
+  const char* skip_escaped(const char* p, char quote)
+  {
+    for(++p; *p; ++p)
+    {
+      if(*p == '\\' && p[1])
+        ++p;
+      else if(*p == quote)
+        return p;
+    }
+    return 0;
+  }
+
+  const char* skip_double_quoted(const char* p)
+  {
+    for(++p; *p; ++p)
+    {
+      if(*p == '\\' && p[1])
+        ++p;
+      else if(*p == '"')
+        return p;
+      else if(*p == '`')
+        p = skip_escaped(p, '`');
+      else if(*p == '$' && (p[1] == '(' || p[1] == '{'))
+        p = skip_group(p + 1, p[1], p[1] == '(' ? ')' : '}');
+
+      if(!p)
+        return 0;
+    }
+    return 0;
+  }
+
+  const char* skip_group(const char* p, char left, char right)
+  {
+    int level = 0;
+    for(; *p; ++p)
+    {
+      if(*p == '\\' && p[1])
+        ++p;
+      else if(*p == '\'')
+        p = skip_single_quoted(p);
+      else if(*p == '"')
+        p = skip_double_quoted(p);
+      else if(*p == '`')
+        p = skip_escaped(p, '`');
+      else if(*p == left)
+        ++level;
+      else if(*p == right && --level == 0)
+        return p;
+
+      if(!p)
+        return 0;
+    }
+    return 0;
+  }
+
+  // p points to the first character after "<<", return the pointer to the
+  // character after the delimiter word
+  const char* read_here_document_word(const char* p, std::vector<std::pair<std::string, bool>>& here_documents)
+  {
+    bool strip_tabs = (*p == '-');
+    if(strip_tabs)
+      ++p;
+    while(is_blank(*p))
+      ++p;
+
+    std::string word;
+    for(; !is_delimiter(*p); ++p)
+    {
+      if(*p == '\'' || *p == '"')
+      {
+        const char* end = strchr(p + 1, *p);
+        if(!end)
+          return 0;
+        word.append(p + 1, end);
+        p = end;
+      }
+      else if(*p == '\\' && p[1])
+      {
+        word += *++p;
+      }
+      else
+      {
+        word += *p;
+      }
+    }
+    if(word.empty())
+      return 0;
+
+    here_documents.push_back(std::make_pair(word, strip_tabs));
+    return p;
+  }
+
+  // p points to the new line that starts the here documents, return the
+  // pointer to the new line after the last delimiter
+  const char* skip_here_documents(const char* p, const std::vector<std::pair<std::string, bool>>& here_documents)
+  {
+    for(auto iter = here_documents.begin(); iter != here_documents.end(); ++iter)
+    {
+      while(true)
+      {
+        if(*p != '\n')
+          return 0;
+        const char* line = p + 1;
+        const char* line_end = strchr(line, '\n');
+        if(!line_end)
+          line_end = line + strlen(line);
+        if(iter->second)
+          while(*line == '\t')
+            ++line;
+        p = line_end;
+        if(iter->first.compare(0, std::string::npos, line,
+                                static_cast<std::string::size_type>(line_end - line)) == 0)
+          break;
+      }
+    }
+    return p;
+  }
+}
+
+const char* find_function_body_end(const char* begin)
+{
+  if(*begin != '{' || !is_delimiter(begin[1]))
+    return 0;
+
+  int level = 0;
+  // whether the next word is at the position of a command
+  bool command_position = true;
+  const char* word_begin = 0;
+  bool word_is_command = false;
+  std::vector<std::pair<std::string, bool>> here_documents;
+
+  for(const char* p = begin; *p; ++p)
+  {
+    char c = *p;
+    // line continuation
+    if(c == '\\' && p[1] == '\n')
+    {
+      ++p;
+      continue;
+    }
+
+    if(is_delimiter(c) && word_begin)
+    {
+      if(word_is_command && is_command_boundary(std::string(word_begin, p)))
+        command_position = true;
+      word_begin = 0;
+    }
+
+    if(c == '\n')
+    {
+      if(!here_documents.empty())
+      {
+        p = skip_here_documents(p, here_documents);
+        if(!p)
+          return 0;
+        here_documents.clear();
+        if(!*p)
+          return 0;
+      }
+      command_position = true;
+    }
+    else if(is_blank(c))
+    {
+    }
+    else if(c == '(' && p[1] == '(')
+    {
+      // arithmetic command, "<<" is a shift here
+      p = skip_group(p, '(', ')');
+      if(!p)
+        return 0;
+      command_position = false;
+    }
+    else if(c == ';' || c == '&' || c == '|' || c == '(' || c == ')')
+    {
+      command_position = true;
+    }
+    else if(c == '<' && p[1] == '<' && p[2] == '<')
+    {
+      p += 2;
+      command_position = false;
+    }
+    else if(c == '<' && p[1] == '<')
+    {
+      p = read_here_document_word(p + 2, here_documents);
+      if(!p)
+        return 0;
+      --p;
+      command_position = false;
+    }
+    else if(c == '<' || c == '>')
+    {
+      command_position = false;
+    }
+    else if(!word_begin && command_position && c == '{' && is_delimiter(p[1]))
+    {
+      ++level;
+    }
+    else if(!word_begin && command_position && c == '}' && is_delimiter(p[1]))
+    {
+      if(--level == 0)
+        return p;
+    }
+    else if(!word_begin && c == '#')
+    {
+      p = strchr(p, '\n');
+      if(!p)
+        return 0;
+      --p;
+    }
+    else
+    {
+      if(!word_begin)
+      {
+        word_begin = p;
+        word_is_command = command_position;
+        command_position = false;
+      }
+
+      if(c == '\\' && p[1])
+        ++p;
+      else if(c == '\'')
+        p = skip_single_quoted(p);
+      else if(c == '"')
+        p = skip_double_quoted(p);
+      else if(c == '`')
+        p = skip_escaped(p, '`');
+      else if(c == '$' && p[1] == '\'')
+        p = skip_escaped(p + 1, '\'');
+      else if(c == '$' && (p[1] == '(' || p[1] == '{'))
+        p = skip_group(p + 1, p[1], p[1] == '(' ? ')' : '}');
+
+      if(!p)
+        return 0;
+    }
+  }
+  return 0;
+}
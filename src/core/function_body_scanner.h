@@ -0,0 +1,36 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+///
+/// \file function_body_scanner.h
+/// \brief a scanner that finds the end of function bodies without parsing
+///
+
+#ifndef LIBBASH_CORE_FUNCTION_BODY_SCANNER_H_
+#define LIBBASH_CORE_FUNCTION_BODY_SCANNER_H_
+
+///
+/// \brief find the right brace that closes the group command starting at
+///        the given left brace. Quotes, escapes, expansions, comments and
+///        here documents are skipped.
+/// \param begin the pointer to the left brace in a null terminated script
+/// \return the pointer to the right brace, null if it can't be found
+const char* find_function_body_end(const char* begin);
+
+#endif
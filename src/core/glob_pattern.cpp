@@ -0,0 +1,598 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file glob_pattern.cpp
+/// \brief implementation for compiled shell patterns
+///
+
+#include "core/glob_pattern.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+
+#include "exceptions.h"
+
+namespace
+{
+  typedef glob_pattern::element element;
+  typedef glob_pattern::sequence sequence;
+  typedef std::string::size_type position;
+  // sorted positions without duplicates
+  typedef std::vector<position> position_set;
+
+  void normalize(position_set& positions)
+  {
+    std::sort(positions.begin(), positions.end());
+    positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+  }
+
+  bool in_class(const std::string& name, int c)
+  {
+    if(name == "alpha")
+      return std::isalpha(c);
+    else if(name == "digit")
+      return std::isdigit(c);
+    else if(name == "alnum")
+      return std::isalnum(c);
+    else if(name == "upper")
+      return std::isupper(c);
+    else if(name == "lower")
+      return std::islower(c);
+    else if(name == "space")
+      return std::isspace(c);
+    else if(name == "blank")
+      return c == ' ' || c == '\t';
+    else if(name == "punct")
+      return std::ispunct(c);
+    else if(name == "print")
+      return std::isprint(c);
+    else if(name == "graph")
+      return std::isgraph(c);
+    else if(name == "cntrl")
+      return std::iscntrl(c);
+    else if(name == "xdigit")
+      return std::isxdigit(c);
+    else
+      throw libbash::parse_exception("unknown character class: " + name);
+  }
+
+  // Read a character of a bracket expression. "\xHH" is a hexadecimal
+  // character and a backslash makes any other character literal.
+  unsigned char read_bracket_char(const std::string& expression, position& i)
+  {
+    if(expression[i] == '\\' && i + 1 != expression.size())
+    {
+      if(expression[i + 1] == 'x' && i + 3 < expression.size()
+         && std::isxdigit(expression[i + 2]) && std::isxdigit(expression[i + 3]))
+      {
+        i += 4;
+        return static_cast<unsigned char>(std::stoi(expression.substr(i - 2, 2), 0, 16));
+      }
+      i += 2;
+      return static_cast<unsigned char>(expression[i - 1]);
+    }
+    return static_cast<unsigned char>(expression[i++]);
+  }
+
+  void parse_bracket_expression(const std::string& expression,
+                                std::bitset<256>& characters)
+  {
+    position i = 0;
+    while(i != expression.size())
+    {
+      if(expression.compare(i, 2, "[:") == 0)
+      {
+        position close = expression.find(":]", i + 2);
+        if(close != std::string::npos)
+        {
+          std::string name = expression.substr(i + 2, close - i - 2);
+          for(int c = 0; c != 256; ++c)
+            if(in_class(name, c))
+              characters.set(static_cast<std::size_t>(c));
+          i = close + 2;
+          continue;
+        }
+      }
+
+      unsigned char low = read_bracket_char(expression, i);
+      if(i + 1 < expression.size() && expression[i] == '-')
+      {
+        ++i;
+        unsigned char high = read_bracket_char(expression, i);
+        for(unsigned c = low; c <= high; ++c)
+          characters.set(c);
+      }
+      else
+      {
+        characters.set(low);
+      }
+    }
+  }
+
+  class pattern_compiler
+  {
+    const std::string& source;
+    position pos;
+
+    bool at_end() const
+    {
+      return pos == source.size();
+    }
+
+    void expect_group_end()
+    {
+      if(at_end() || source[pos] != ')')
+        throw libbash::parse_exception("unterminated extended pattern: " + source);
+      ++pos;
+    }
+
+    void add_literal(sequence& elements, char c)
+    {
+      if(elements.empty() || elements.back().type != element::literal)
+      {
+        elements.push_back(element());
+        elements.back().type = element::literal;
+      }
+      elements.back().text += c;
+    }
+
+    void add(sequence& elements, element::element_type type)
+    {
+      // Consecutive stars are the same as one
+      if(type == element::any_string && !elements.empty() && elements.back().type == type)
+        return;
+      elements.push_back(element());
+      elements.back().type = type;
+    }
+
+    void parse_bracket(sequence& elements)
+    {
+      std::string expression;
+      bool negation = false;
+      // Only the first '!' or '^' negates, an escaped one is literal
+      if(!at_end() && (source[pos] == '!' || source[pos] == '^'))
+      {
+        negation = true;
+        ++pos;
+      }
+      while(!at_end() && source[pos] != ']')
+      {
+        if(source[pos] == '\\')
+          ++pos;
+        if(at_end())
+          break;
+        expression += source[pos++];
+      }
+      if(at_end())
+        throw libbash::parse_exception("unterminated bracket expression: " + source);
+      ++pos;
+
+      add(elements, element::char_set);
+      parse_bracket_expression(expression, elements.back().characters);
+      if(negation)
+        elements.back().characters.flip();
+    }
+
+    sequence parse_sequence()
+    {
+      sequence elements;
+      while(!at_end() && source[pos] != '|' && source[pos] != ')')
+      {
+        char c = source[pos++];
+        if(c == '\\')
+        {
+          if(!at_end())
+            add_literal(elements, source[pos++]);
+        }
+        else if((c == '?' || c == '*' || c == '+' || c == '@' || c == '!')
+                && !at_end() && source[pos] == '(')
+        {
+          ++pos;
+          element group;
+          group.type = element::group;
+          group.quantifier = c;
+          parse_branches(group.branches);
+          expect_group_end();
+          elements.push_back(group);
+          extended = true;
+        }
+        else if(c == '*')
+        {
+          add(elements, element::any_string);
+        }
+        else if(c == '?')
+        {
+          add(elements, element::any_char);
+        }
+        else if(c == '[')
+        {
+          parse_bracket(elements);
+        }
+        else
+        {
+          add_literal(elements, c);
+        }
+      }
+      return elements;
+    }
+
+  public:
+    bool extended;
+
+    pattern_compiler(const std::string& source_): source(source_), pos(0), extended(false) {}
+
+    void parse_branches(std::vector<sequence>& branches)
+    {
+      branches.push_back(parse_sequence());
+      while(!at_end() && source[pos] == '|')
+      {
+        ++pos;
+        branches.push_back(parse_sequence());
+      }
+    }
+
+    void compile(std::vector<sequence>& branches)
+    {
+      parse_branches(branches);
+      if(!at_end())
+        throw libbash::parse_exception("unmatched ')' in pattern: " + source);
+    }
+  };
+
+  // Finds all the positions that a pattern can reach from a set of
+  // positions. Moving backward is used for matches that stop at the end.
+  class matcher
+  {
+    const std::string& value;
+    bool backward;
+
+    void step(const element& e, const position_set& from, position_set& to) const
+    {
+      to.clear();
+      switch(e.type)
+      {
+        case element::literal:
+        {
+          position length = e.text.size();
+          for(auto iter = from.begin(); iter != from.end(); ++iter)
+          {
+            if(backward)
+            {
+              if(*iter >= length && value.compare(*iter - length, length, e.text) == 0)
+                to.push_back(*iter - length);
+            }
+            else if(value.size() - *iter >= length && value.compare(*iter, length, e.text) == 0)
+            {
+              to.push_back(*iter + length);
+            }
+          }
+          break;
+        }
+        case element::any_char:
+        case element::char_set:
+          for(auto iter = from.begin(); iter != from.end(); ++iter)
+          {
+            if(backward ? *iter == 0 : *iter == value.size())
+              continue;
+            position next = backward ? *iter - 1 : *iter + 1;
+            unsigned char c = static_cast<unsigned char>(value[backward ? next : *iter]);
+            if(e.type == element::any_char || e.characters[c])
+              to.push_back(next);
+          }
+          break;
+        case element::any_string:
+          if(backward)
+          {
+            for(position i = 0; i <= from.back(); ++i)
+              to.push_back(i);
+          }
+          else
+          {
+            for(position i = from.front(); i <= value.size(); ++i)
+              to.push_back(i);
+          }
+          break;
+        case element::group:
+          step_group(e, from, to);
+          break;
+      }
+    }
+
+    void step_group(const element& e, const position_set& from, position_set& to) const
+    {
+      switch(e.quantifier)
+      {
+        case '@':
+          step_branches(e.branches, from, to);
+          break;
+        case '?':
+          step_branches(e.branches, from, to);
+          to.insert(to.end(), from.begin(), from.end());
+          normalize(to);
+          break;
+        case '*':
+          closure(e.branches, from, to);
+          break;
+        case '+':
+        {
+          position_set once;
+          step_branches(e.branches, from, once);
+          closure(e.branches, once, to);
+          break;
+        }
+        default:
+        {
+          // !(...) matches the strings that none of the branches matches
+          position_set start(1), matched;
+          for(auto iter = from.begin(); iter != from.end(); ++iter)
+          {
+            start[0] = *iter;
+            step_branches(e.branches, start, matched);
+            position first = backward ? 0 : *iter;
+            position last = backward ? *iter : value.size();
+            for(position i = first; i <= last; ++i)
+              if(!std::binary_search(matched.begin(), matched.end(), i))
+                to.push_back(i);
+          }
+          normalize(to);
+        }
+      }
+    }
+
+    // the positions reachable by repeating the branches zero or more times
+    void closure(const std::vector<sequence>& branches,
+                 const position_set& start,
+                 position_set& result) const
+    {
+      result = start;
+      position_set frontier = start;
+      position_set next, added, merged;
+      while(!frontier.empty())
+      {
+        step_branches(branches, frontier, next);
+        added.clear();
+        std::set_difference(next.begin(), next.end(),
+                            result.begin(), result.end(),
+                            std::back_inserter(added));
+        merged.clear();
+        std::set_union(result.begin(), result.end(),
+                       added.begin(), added.end(),
+                       std::back_inserter(merged));
+        result.swap(merged);
+        frontier.swap(added);
+      }
+    }
+
+    void step_sequence(const sequence& elements,
+                       const position_set& from,
+                       position_set& to) const
+    {
+      to = from;
+      position_set next;
+      for(position i = 0; i != elements.size() && !to.empty(); ++i)
+      {
+        step(elements[backward ? elements.size() - 1 - i : i], to, next);
+        to.swap(next);
+      }
+    }
+
+  public:
+    matcher(const std::string& value_, bool backward_): value(value_), backward(backward_) {}
+
+    void step_branches(const std::vector<sequence>& branches,
+                       const position_set& from,
+                       position_set& to) const
+    {
+      if(branches.size() == 1)
+        return step_sequence(branches[0], from, to);
+
+      to.clear();
+      position_set reached;
+      for(auto iter = branches.begin(); iter != branches.end(); ++iter)
+      {
+        step_sequence(*iter, from, reached);
+        to.insert(to.end(), reached.begin(), reached.end());
+      }
+      normalize(to);
+    }
+  };
+
+  bool starts_with(const std::string& value, const std::string& text)
+  {
+    return value.compare(0, text.size(), text) == 0;
+  }
+
+  bool ends_with(const std::string& value, const std::string& text)
+  {
+    return value.size() >= text.size()
+      && value.compare(value.size() - text.size(), text.size(), text) == 0;
+  }
+}
+
+glob_pattern::glob_pattern(const std::string& source, bool greedy_, anchor_type anchor_):
+  greedy(greedy_), anchor(anchor_), is_literal(false)
+{
+  pattern_compiler compiler(source);
+  compiler.compile(branches);
+  extended = compiler.extended;
+
+  if(branches.size() == 1)
+  {
+    const sequence& elements = branches[0];
+    if(elements.empty())
+    {
+      is_literal = true;
+    }
+    else
+    {
+      if(elements.front().type == element::literal)
+      {
+        prefix = elements.front().text;
+        is_literal = (elements.size() == 1);
+      }
+      if(elements.size() > 1 && elements.back().type == element::literal)
+        suffix = elements.back().text;
+    }
+  }
+}
+
+bool glob_pattern::match(const std::string& value) const
+{
+  if(is_literal)
+    return value == prefix;
+  if(value.size() < prefix.size() + suffix.size()
+     || !starts_with(value, prefix) || !ends_with(value, suffix))
+    return false;
+
+  position_set start(1, 0), reached;
+  matcher(value, false).step_branches(branches, start, reached);
+  return !reached.empty() && reached.back() == value.size();
+}
+
+bool glob_pattern::search(const std::string& value,
+                          std::string::size_type from,
+                          std::string::size_type& begin,
+                          std::string::size_type& end) const
+{
+  position_set start(1), reached;
+
+  if(anchor == at_start)
+  {
+    if(!starts_with(value, prefix))
+      return false;
+    start[0] = 0;
+    matcher(value, false).step_branches(branches, start, reached);
+    if(reached.empty())
+      return false;
+    begin = 0;
+    end = greedy ? reached.back() : reached.front();
+    return true;
+  }
+  else if(anchor == at_end)
+  {
+    if(!ends_with(value, is_literal ? prefix : suffix))
+      return false;
+    start[0] = value.size();
+    matcher(value, true).step_branches(branches, start, reached);
+    if(reached.empty())
+      return false;
+    begin = greedy ? reached.front() : reached.back();
+    end = value.size();
+    return true;
+  }
+
+  if(is_literal)
+  {
+    begin = value.find(prefix, from);
+    end = begin + prefix.size();
+    return begin != std::string::npos;
+  }
+
+  matcher forward(value, false);
+  for(position i = from; i <= value.size(); ++i)
+  {
+    // Only try the positions where the literal prefix is found
+    if(!prefix.empty())
+    {
+      i = value.find(prefix, i);
+      if(i == std::string::npos)
+        return false;
+    }
+    start[0] = i;
+    forward.step_branches(branches, start, reached);
+    if(!reached.empty())
+    {
+      begin = i;
+      end = greedy ? reached.back() : reached.front();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool glob_pattern::get_literal_branches(std::vector<std::string>& literals) const
+{
+  bool all_literal = true;
+  for(auto iter = branches.begin(); iter != branches.end(); ++iter)
+  {
+    if(iter->empty())
+      literals.push_back("");
+    else if(iter->size() == 1 && iter->front().type == element::literal)
+      literals.push_back(iter->front().text);
+    else
+      all_literal = false;
+  }
+  return all_literal;
+}
+
+void glob_pattern::append_literal(std::string& source, const std::string& text)
+{
+  static const std::string special_characters = "\\*?+@![|()";
+  for(auto iter = text.begin(); iter != text.end(); ++iter)
+  {
+    if(special_characters.find(*iter) != std::string::npos)
+      source += '\\';
+    source += *iter;
+  }
+}
+
+void glob_pattern::append_bracket(std::string& source,
+                                  const std::string& expression,
+                                  bool negation)
+{
+  source += negation ? "[!" : "[";
+  for(auto iter = expression.begin(); iter != expression.end(); ++iter)
+  {
+    // a leading '!' or '^' would be taken as negation
+    if(*iter == '\\' || *iter == ']'
+       || ((*iter == '!' || *iter == '^') && iter == expression.begin()))
+      source += '\\';
+    source += *iter;
+  }
+  source += ']';
+}
+
+void glob_pattern_set::add(const std::shared_ptr<const glob_pattern>& pattern)
+{
+  std::size_t clause = static_clauses.size();
+  static_clauses.push_back(static_cast<bool>(pattern));
+  if(!pattern)
+    return;
+
+  std::vector<std::string> texts;
+  bool all_literal = pattern->get_literal_branches(texts);
+  // insert keeps the earlier clause of the same text
+  for(auto iter = texts.begin(); iter != texts.end(); ++iter)
+    literals.insert(std::make_pair(*iter, clause));
+  if(!all_literal)
+    patterns.push_back(std::make_pair(clause, pattern));
+}
+
+int glob_pattern_set::find(const std::string& value) const
+{
+  auto literal = literals.find(value);
+  std::size_t limit = (literal == literals.end() ? static_clauses.size() : literal->second);
+
+  for(auto iter = patterns.begin(); iter != patterns.end() && iter->first < limit; ++iter)
+    if(iter->second->match(value))
+      return static_cast<int>(iter->first);
+
+  return limit == static_clauses.size() ? -1 : static_cast<int>(limit);
+}
@@ -0,0 +1,197 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file glob_pattern.h
+/// \brief compiled shell patterns
+///
+
+#ifndef LIBBASH_CORE_GLOB_PATTERN_H_
+#define LIBBASH_CORE_GLOB_PATTERN_H_
+
+#include <bitset>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+///
+/// \class glob_pattern
+/// \brief a shell pattern compiled from its source text. The source text is
+///        built by the walker: literal characters are escaped by a
+///        backslash, '*' and '?' are wildcards, "[...]" and "[!...]" are
+///        bracket expressions whose content is escaped by append_bracket,
+///        "?(", "*(", "+(", "@(" and "!(" start extended patterns whose
+///        branches are separated by '|' and closed by ')'. Top level
+///        branches separated by '|' are alternatives, like in case clauses.
+///        Matching keeps the set of positions the pattern can reach so it
+///        never backtracks.
+///
+class glob_pattern
+{
+public:
+  /// \brief how the pattern is applied to the value
+  enum anchor_type
+  {
+    /// the pattern can match anywhere in the value
+    anywhere,
+    /// the match must start at the beginning of the value
+    at_start,
+    /// the match must stop at the end of the value
+    at_end
+  };
+
+  /// \brief a compiled piece of a pattern
+  struct element
+  {
+    enum element_type
+    {
+      /// the text in text
+      literal,
+      /// any single character
+      any_char,
+      /// a single character in characters
+      char_set,
+      /// any string
+      any_string,
+      /// an extended pattern made of branches
+      group
+    };
+
+    element_type type;
+    std::string text;
+    std::bitset<256> characters;
+    /// \brief the operator of the extended pattern, one of "?*+@!"
+    char quantifier;
+    std::vector<std::vector<element>> branches;
+  };
+
+  /// \brief the elements of a branch
+  typedef std::vector<element> sequence;
+
+private:
+  std::vector<sequence> branches;
+  bool greedy;
+  anchor_type anchor;
+  bool extended;
+
+  /// \brief the literal text that every match starts with
+  std::string prefix;
+  /// \brief the literal text that every match ends with
+  std::string suffix;
+  /// \brief whether the pattern only matches prefix
+  bool is_literal;
+
+public:
+  /// \brief compile a pattern
+  /// \param source the source text of the pattern
+  /// \param greedy whether search finds the longest match or the shortest
+  /// \param anchor how the pattern is applied to the value
+  glob_pattern(const std::string& source, bool greedy, anchor_type anchor=anywhere);
+
+  /// \brief whether the pattern uses extended patterns
+  /// \return true if extglob is needed by the pattern
+  bool uses_extglob() const
+  {
+    return extended;
+  }
+
+  /// \brief get how the pattern is applied to the value
+  /// \return the anchor type
+  anchor_type get_anchor() const
+  {
+    return anchor;
+  }
+
+  /// \brief check if the whole value matches the pattern
+  /// \param value the value to be matched
+  /// \return true if the value matches the pattern
+  bool match(const std::string& value) const;
+
+  /// \brief find a match of the pattern in the value. A match starting at
+  ///        the beginning or stopping at the end is required when the
+  ///        pattern is anchored. Otherwise the leftmost match starting from
+  ///        the given position is found. The longest match is chosen if
+  ///        the pattern is greedy, the shortest otherwise.
+  /// \param value the value to be searched
+  /// \param from where to start searching, ignored by anchored patterns
+  /// \param[out] begin the position where the match starts
+  /// \param[out] end the position where the match stops
+  /// \return whether a match is found
+  bool search(const std::string& value,
+              std::string::size_type from,
+              std::string::size_type& begin,
+              std::string::size_type& end) const;
+
+  /// \brief get the text of the branches that only match literal text
+  /// \param[out] literals the text of the literal branches
+  /// \return whether all the branches are literal
+  bool get_literal_branches(std::vector<std::string>& literals) const;
+
+  /// \brief append literal text to the source text of a pattern
+  /// \param[in, out] source the source text
+  /// \param text the literal text
+  static void append_literal(std::string& source, const std::string& text);
+
+  /// \brief append a bracket expression to the source text of a pattern
+  /// \param[in, out] source the source text
+  /// \param expression the content of the bracket expression, using the
+  ///        syntax of regular expression character sets
+  /// \param negation whether the bracket expression is negated
+  static void append_bracket(std::string& source,
+                             const std::string& expression,
+                             bool negation);
+};
+
+///
+/// \class glob_pattern_set
+/// \brief the patterns of the clauses of a case statement. The first
+///        matching clause among the clauses without expansions is found at
+///        once: literal clauses are looked up in a hash table, the others
+///        are only tried until the clause found there.
+///
+class glob_pattern_set
+{
+  /// \brief the first clause of each literal text
+  std::unordered_map<std::string, std::size_t> literals;
+  /// \brief the clauses that are not all literal, in clause order
+  std::vector<std::pair<std::size_t, std::shared_ptr<const glob_pattern>>> patterns;
+  /// \brief whether each clause has no expansion
+  std::vector<bool> static_clauses;
+
+public:
+  /// \brief add the next clause
+  /// \param pattern the compiled pattern of the clause, null if the
+  ///        pattern contains expansions
+  void add(const std::shared_ptr<const glob_pattern>& pattern);
+
+  /// \brief check whether a clause is compiled into the set
+  /// \param clause the index of the clause
+  /// \return false if the pattern of the clause contains expansions
+  bool is_static(std::size_t clause) const
+  {
+    return clause < static_clauses.size() && static_clauses[clause];
+  }
+
+  /// \brief find the first clause without expansions that matches a value
+  /// \param value the value to be matched
+  /// \return the index of the clause, -1 if no clause matches
+  int find(const std::string& value) const;
+};
+
+#endif
@@ -26,11 +26,10 @@
 
 #include <functional>
 #include <limits>
+#include <mutex>
 
 #include <boost/algorithm/string/classification.hpp>
-#include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
-#include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/foreach.hpp>
 #include <boost/range/adaptor/filtered.hpp>
@@ -41,6 +40,8 @@
 #include <boost/spirit/include/qi.hpp>
 
 #include "core/bash_ast.h"
+#include "core/bash_condition.h"
+#include "core/symbol_ids.h"
 
 namespace
 {
@@ -58,7 +59,7 @@ namespace
   }
 }
 
-interpreter::interpreter(): _out(&std::cout), _err(&std::cerr), _in(&std::cin), additional_options(
+interpreter::interpreter(): local_depth(0), _out(&std::cout), _err(&std::cerr), _in(&std::cin), additional_options(
     {
       {"autocd", false},
       {"cdable_vars", false},
@@ -123,35 +124,80 @@ interpreter::interpreter(): _out(&std::cout), _err(&std::cerr), _in(&std::cin),
       {'P', false},
       {'T', false},
     }
-    ), status(0)
+    ), status(0), pattern_cache(256), regex_cache(256)
 {
   define("IFS", " \t\n");
   // We do not support the options set by the shell itself (such as the -i option)
   define("-", get_options(options));
 }
 
-std::shared_ptr<variable> interpreter::resolve_variable(const std::string& name) const
+interpreter::interpreter(const std::shared_ptr<const interpreter>& base_interpreter):
+  members(base_interpreter->members),
+  functions(base_interpreter->functions),
+  local_members(base_interpreter->local_depth),
+  local_depth(base_interpreter->local_depth),
+  local_bindings(base_interpreter->local_bindings),
+  _out(base_interpreter->_out),
+  _err(base_interpreter->_err),
+  _in(base_interpreter->_in),
+  additional_options(base_interpreter->additional_options),
+  options(base_interpreter->options),
+  status(base_interpreter->status),
+  pattern_cache(256),
+  regex_cache(256),
+  file_statuses(base_interpreter->file_statuses)
+{
+  // Only global variables are shared
+  for(auto i = 0u; i != local_depth; ++i)
+    local_members[i].symbols = base_interpreter->local_members[i].symbols;
+  BOOST_FOREACH(auto& bindings, local_bindings)
+  {
+    BOOST_FOREACH(auto& binding, bindings.second)
+    {
+      auto& frame = local_members[binding.depth - 1];
+      frame.variables.push_back(*binding.var);
+      binding.var = &frame.variables.back();
+    }
+  }
+}
+
+variable* interpreter::resolve_local_variable(const std::string& name, symbol_id id) const
+{
+  if(local_depth == 0)
+    return 0;
+
+  // A name that has never been interned can't be a local variable
+  if(!id.is_known() && !find_symbol_id(name, id.value))
+    return 0;
+  auto iter = local_bindings.find(id.value);
+  if(iter == local_bindings.end() || iter->second.empty())
+    return 0;
+  return iter->second.back().var;
+}
+
+variable* interpreter::resolve_variable(const std::string& name, symbol_id id) const
 {
   if(name.empty())
-    return std::shared_ptr<variable>();
+    return 0;
 
-  BOOST_REVERSE_FOREACH(auto& frame, local_members)
-  {
-    auto iter_local = frame.find(name);
-    if(iter_local != frame.end())
-      return iter_local->second;
-  }
+  auto var = resolve_local_variable(name, id);
+  return var ? var : members.find(name);
+}
+
+variable* interpreter::resolve_variable_for_write(const std::string& name, symbol_id id)
+{
+  if(name.empty())
+    return 0;
 
-  auto iter_global = members.find(name);
-  if(iter_global == members.end())
-    return std::shared_ptr<variable>();
-  return iter_global->second;
+  auto var = resolve_local_variable(name, id);
+  return var ? var : members.find_for_write(name);
 }
 
 bool interpreter::is_unset_or_null(const std::string& name,
-                                   const unsigned index) const
+                                   const unsigned index,
+                                   symbol_id id) const
 {
-  auto var = resolve_variable(name);
+  auto var = resolve_variable(name, id);
   if(!var)
     return true;
   return var->is_null(index);
@@ -162,7 +208,12 @@ std::string interpreter::get_substring(const std::string& name,
                                        unsigned length,
                                        const unsigned index) const
 {
-  std::string value = resolve<std::string>(name, index);
+  auto var = resolve_set_variable(name, index);
+  if(!var)
+    return "";
+
+  // Only the substring is copied
+  const std::string& value = var->get_string(index);
   if(!get_real_offset(offset, boost::numeric_cast<unsigned>(value.size())))
     return "";
   // After get_real_offset, we know offset can be cast to unsigned.
@@ -187,36 +238,74 @@ const std::string interpreter::do_substring_expansion(const std::string& name,
   return get_substring(name, offset, boost::numeric_cast<unsigned>(length), index);
 }
 
+namespace
+{
+  // Join the values with one allocation for the result
+  template<typename Iterator>
+  void join_values(Iterator begin, Iterator end, const std::string& delimiter, std::string& result)
+  {
+    std::string::size_type size = 0;
+    for(auto iter = begin; iter != end; ++iter)
+      size += (*iter)->size() + delimiter.size();
+
+    result.clear();
+    result.reserve(size);
+    for(auto iter = begin; iter != end; ++iter)
+    {
+      if(iter != begin)
+        result += delimiter;
+      result += **iter;
+    }
+  }
+}
+
+std::string interpreter::get_ifs_delimiter() const
+{
+  return resolve<std::string>("IFS").substr(0, 1);
+}
+
 std::string interpreter::get_subarray(const std::string& name,
                                       long long offset,
                                       unsigned length) const
 {
-  std::vector<std::string> array;
+  std::string script_name;
+  std::vector<const std::string*> array;
   if(name == "*" || name == "@")
   {
     // ${*:1} has the same content as ${*}, ${*:0} contains current script name as the first element
     if(offset > 0)
+    {
       offset--;
+    }
     else if(offset == 0)
-      array.push_back(resolve<std::string>("0"));
+    {
+      script_name = resolve<std::string>("0");
+      array.push_back(&script_name);
+    }
   }
+
+  auto var = resolve_variable(name);
+  if(!is_valid(var, name))
+    return "";
+
+  array.reserve(array.size() + var->get_array_length());
+  var->for_each_string([&](const std::string& value) { array.push_back(&value); });
+
   // We do not support arrays that have size bigger than numeric_limits<unsigned>::max()
-  if(resolve_array(name, array) && get_real_offset(offset, boost::numeric_cast<unsigned>(array.size())))
-  {
-    // We do not support arrays that have size bigger than numeric_limits<unsigned>::max()
-    // After get_real_offset, we know offset can be cast to unsigned.
-    unsigned max_length = boost::numeric_cast<unsigned>(array.size()) - boost::numeric_cast<unsigned>(offset);
-    if(length > max_length)
-      length = max_length;
-
-    auto start = array.begin() + boost::numeric_cast<std::vector<std::string>::difference_type>(offset);
-    auto end = array.begin() + boost::numeric_cast<std::vector<std::string>::difference_type>(offset + length);
-    return boost::algorithm::join(std::vector<std::string>(start, end), resolve<std::string>("IFS").substr(0, 1));
-  }
-  else
-  {
+  if(!get_real_offset(offset, boost::numeric_cast<unsigned>(array.size())))
     return "";
-  }
+
+  // After get_real_offset, we know offset can be cast to unsigned.
+  unsigned max_length = boost::numeric_cast<unsigned>(array.size()) - boost::numeric_cast<unsigned>(offset);
+  if(length > max_length)
+    length = max_length;
+
+  std::string result;
+  join_values(array.begin() + boost::numeric_cast<std::vector<std::string>::difference_type>(offset),
+              array.begin() + boost::numeric_cast<std::vector<std::string>::difference_type>(offset + length),
+              get_ifs_delimiter(),
+              result);
+  return result;
 }
 
 const std::string interpreter::do_subarray_expansion(const std::string& name,
@@ -247,11 +336,23 @@ std::string interpreter::do_replace_expansion(const std::string& name,
 std::string interpreter::do_array_replace_expansion(const std::string& name,
                                                     std::function<void(std::string&)> replacer) const
 {
-  std::vector<std::string> array;
-  resolve_array<std::string>(name, array);
-  for(auto i = array.begin(); i != array.end(); ++i)
-    replacer(*i);
-  return boost::algorithm::join(array, resolve<std::string>("IFS").substr(0, 1));
+  std::string result;
+  auto var = resolve_variable(name);
+  if(!is_valid(var, name))
+    return result;
+
+  const std::string delimiter = get_ifs_delimiter();
+  std::string value;
+  bool first = true;
+  var->for_each_string([&](const std::string& element) {
+    value = element;
+    replacer(value);
+    if(!first)
+      result += delimiter;
+    result += value;
+    first = false;
+  });
+  return result;
 }
 
 std::string::size_type interpreter::get_length(const std::string& name,
@@ -275,12 +376,17 @@ void interpreter::get_all_elements_joined(const std::string& name,
                                           const std::string& delim,
                                           std::string& result) const
 {
-  std::vector<std::string> array;
-
-  if(resolve_array(name, array))
-    result = boost::algorithm::join(array, delim);
-  else
+  auto var = resolve_variable(name);
+  if(!is_valid(var, name))
+  {
     result = "";
+    return;
+  }
+
+  std::vector<const std::string*> array;
+  array.reserve(var->get_array_length());
+  var->for_each_string([&](const std::string& value) { array.push_back(&value); });
+  join_values(array.begin(), array.end(), delim, result);
 }
 
 void interpreter::get_all_elements(const std::string& name,
@@ -292,49 +398,92 @@ void interpreter::get_all_elements(const std::string& name,
 void interpreter::get_all_elements_IFS_joined(const std::string& name,
                                               std::string& result) const
 {
-  get_all_elements_joined(name,
-                          resolve<std::string>("IFS").substr(0, 1),
-                          result);
+  get_all_elements_joined(name, get_ifs_delimiter(), result);
+}
+
+interpreter::field_splitter interpreter::get_field_splitter() const
+{
+  static const std::string empty;
+  static const symbol_id ifs_id(get_symbol_id("IFS"));
+
+  // Compare against the stored value so IFS is not copied for every split
+  auto var = resolve_set_variable("IFS", 0, ifs_id);
+  const std::string& delimiter = var ? var->get_string() : empty;
+  if(delimiter != ifs_value)
+  {
+    ifs_value = delimiter;
+    ifs_table.reset();
+    BOOST_FOREACH(char c, delimiter)
+      ifs_table.set(static_cast<unsigned char>(c));
+  }
+  return field_splitter(ifs_table);
 }
 
 void interpreter::split_word(const std::string& word, std::vector<std::string>& output) const
 {
-  const std::string& delimeter = resolve<std::string>("IFS");
-  std::string trimmed(word);
-  boost::trim_if(trimmed, boost::is_any_of(delimeter));
+  field_splitter splitter(get_field_splitter());
+  std::string::size_type position = 0;
+  std::string field;
+  while(splitter.next(word, position, field))
+    output.push_back(field);
+}
 
-  if(trimmed == "")
-    return;
+void interpreter::define_local_variable(const std::string& name, variable&& var, symbol_id id)
+{
+  if(!id.is_known())
+    id.value = get_symbol_id(name);
 
-  std::vector<std::string> splitted_values;
-  boost::split(splitted_values, trimmed, boost::is_any_of(delimeter), boost::token_compress_on);
-  output.insert(output.end(), splitted_values.begin(), splitted_values.end());
+  auto& bindings = local_bindings[id.value];
+  if(!bindings.empty() && bindings.back().depth == local_depth)
+  {
+    *bindings.back().var = std::move(var);
+  }
+  else
+  {
+    auto& frame = local_members[local_depth - 1];
+    frame.variables.push_back(std::move(var));
+    local_binding binding = {local_depth, &frame.variables.back()};
+    bindings.push_back(binding);
+    frame.symbols.push_back(id.value);
+  }
 }
 
-void interpreter::define_function_arguments(scope& current_stack,
-                                            const std::vector<std::string>& arguments)
+void interpreter::push_local_scope()
 {
-  std::map<unsigned, std::string> positional_args;
+  if(local_depth == local_members.size())
+    local_members.push_back(local_frame());
+  ++local_depth;
+}
 
-  for(auto i = 1u; i <= arguments.size(); ++i)
-    positional_args[i] = arguments[i - 1];
+void interpreter::pop_local_scope()
+{
+  // A variable may have been unset already
+  auto& frame = local_members[local_depth - 1];
+  BOOST_FOREACH(unsigned id, frame.symbols)
+  {
+    auto& bindings = local_bindings[id];
+    if(!bindings.empty() && bindings.back().depth == local_depth)
+      bindings.pop_back();
+  }
+  frame.symbols.clear();
+  frame.variables.clear();
+  --local_depth;
+}
 
-  current_stack["*"].reset(new variable("*", positional_args));
+void interpreter::define_function_arguments(const std::vector<std::string>& arguments)
+{
+  define_local_variable("*", variable("*", arguments, false, 1));
 }
 
 void interpreter::define_positional_arguments(const std::vector<std::string>::const_iterator begin,
                                               const std::vector<std::string>::const_iterator end)
 {
-  std::map<unsigned, std::string> positional_args;
-  std::vector<std::string>::const_iterator iter = begin;
-
-  for(auto i = 1u; iter != end ; ++i, ++iter)
-    positional_args[i] = *iter;
+  std::vector<std::string> positional_args(begin, end);
 
-  if(local_members.size() < 1)
-    define("*", positional_args);
+  if(local_depth == 0)
+    define("*", positional_args, false, 1);
   else
-    define_local("*", positional_args);
+    define_local("*", positional_args, false, 1);
 }
 
 namespace
@@ -358,11 +507,19 @@ void interpreter::define_function(const std::string& name,
   functions.insert(make_pair(name, function(*ast_stack.top(), body_index)));
 }
 
+void interpreter::define_lazy_function(const std::string& name,
+                                       pANTLR3_BASE_TREE lazy_body)
+{
+  if(!check_function_name(name))
+    throw libbash::parse_exception("illegal function name: " + name);
+  functions.insert(make_pair(name, function(*ast_stack.top(), lazy_body)));
+}
+
 void interpreter::call(const std::string& name,
                        const std::vector<std::string>& arguments)
 {
   // Prepare arguments
-  define_function_arguments(local_members.back(), arguments);
+  define_function_arguments(arguments);
 
   auto iter = functions.find(name);
   if(iter != functions.end())
@@ -371,34 +528,107 @@ void interpreter::call(const std::string& name,
     throw libbash::runtime_exception(name + " is not defined.");
 }
 
+std::shared_ptr<const glob_pattern> interpreter::get_glob_pattern(const std::string& source,
+                                                              bool greedy,
+                                                              glob_pattern::anchor_type anchor)
+{
+  std::string key(1, static_cast<char>(anchor * 2 + greedy));
+  key += source;
+
+  auto cached = pattern_cache.get(key);
+  if(cached)
+    return *cached;
+
+  std::shared_ptr<const glob_pattern> pattern(new glob_pattern(source, greedy, anchor));
+  pattern_cache.put(key, pattern);
+  return pattern;
+}
+
+void interpreter::invalidate_file_status(const std::string& path)
+{
+  if(file_statuses)
+    file_statuses->invalidate(path);
+}
+
+bool interpreter::match_regex(const std::string& value, const std::string& regex)
+{
+  using namespace boost::xpressive;
+
+  std::shared_ptr<const sregex> compiled;
+  auto cached = regex_cache.get(regex);
+  if(cached)
+  {
+    compiled = *cached;
+  }
+  else
+  {
+    compiled.reset(new sregex(sregex::compile(regex)));
+    regex_cache.put(regex, compiled);
+  }
+
+  smatch what;
+  std::vector<std::string> groups;
+  bool matched = regex_search(value, what, *compiled);
+  if(matched)
+  {
+    for(auto iter = what.begin(); iter != what.end(); ++iter)
+      groups.push_back(iter->str());
+  }
+  // Like set_value, a local BASH_REMATCH is updated instead of the global
+  auto var = resolve_variable_for_write("BASH_REMATCH");
+  if(!var)
+    define("BASH_REMATCH", groups);
+  else if(var->is_readonly())
+    throw libbash::readonly_exception("BASH_REMATCH is readonly variable");
+  else
+    *var = variable("BASH_REMATCH", groups);
+  return matched;
+}
+
 void interpreter::replace_all(std::string& value,
-                              const boost::xpressive::sregex& pattern,
+                              const glob_pattern& pattern,
                               const std::string& replacement)
 {
-  value = boost::xpressive::regex_replace(value,
-                                          pattern,
-                                          replacement,
-                                          boost::xpressive::regex_constants::format_literal);
+  std::string::size_type begin, end;
+  if(pattern.get_anchor() != glob_pattern::anywhere)
+  {
+    if(pattern.search(value, 0, begin, end))
+      value.replace(begin, end - begin, replacement);
+    return;
+  }
+
+  std::string result;
+  std::string::size_type position = 0;
+  while(pattern.search(value, position, begin, end))
+  {
+    result.append(value, position, begin - position);
+    result += replacement;
+    // Keep one character after an empty match like bash does
+    if(begin == end && end != value.size())
+      result += value[end++];
+    position = end;
+    if(position == value.size())
+      break;
+  }
+  result.append(value, position, std::string::npos);
+  value.swap(result);
 }
 
 void interpreter::lazy_remove_at_end(std::string& value,
-                              const boost::xpressive::sregex& pattern)
+                                     const glob_pattern& pattern)
 {
-  boost::xpressive::smatch what;
-  if(boost::xpressive::regex_match(value,
-                                   what,
-                                   pattern))
-    value = what[1];
+  std::string::size_type begin, end;
+  if(pattern.search(value, 0, begin, end))
+    value.erase(begin);
 }
 
 void interpreter::replace_first(std::string& value,
-                                const boost::xpressive::sregex& pattern,
+                                const glob_pattern& pattern,
                                 const std::string& replacement)
 {
-  value = boost::xpressive::regex_replace(value,
-                                          pattern,
-                                          replacement,
-                                          boost::xpressive::regex_constants::format_literal | boost::xpressive::regex_constants::format_first_only);
+  std::string::size_type begin, end;
+  if(pattern.search(value, 0, begin, end))
+    value.replace(begin, end - begin, replacement);
 }
 
 void interpreter::trim_trailing_eols(std::string& value)
@@ -425,20 +655,21 @@ void interpreter::unset(const std::string& name)
 {
   check_unset_positional(name);
 
-  auto unsetter = [&](scope& frame) -> bool {
-    auto iter_local = frame.find(name);
-    if(iter_local != frame.end())
-    {
-      if(iter_local->second->is_readonly())
-        throw libbash::readonly_exception("unset a readonly variable");
-      frame.erase(iter_local);
-      return true;
-    }
-    return false;
-  };
+  auto var = resolve_local_variable(name);
+  if(var)
+  {
+    if(var->is_readonly())
+      throw libbash::readonly_exception("unset a readonly variable");
+    unsigned id;
+    find_symbol_id(name, id);
+    local_bindings[id].pop_back();
+    return;
+  }
 
-  if(std::none_of(local_members.rbegin(), local_members.rend(), unsetter))
-    unsetter(members);
+  var = members.find(name);
+  if(var && var->is_readonly())
+    throw libbash::readonly_exception("unset a readonly variable");
+  members.erase(name);
 }
 
 // We need to return false when unsetting readonly functions in future
@@ -454,7 +685,7 @@ void interpreter::unset(const std::string& name,
 {
   check_unset_positional(name);
 
-  auto var = resolve_variable(name);
+  auto var = resolve_variable_for_write(name);
   if(var)
   {
     if(var->is_readonly())
@@ -499,15 +730,39 @@ void interpreter::set_option(const char name, bool value)
   iter->second = value;
 }
 
+namespace
+{
+  // Parsed arithmetic expressions are shared by all interpreters
+  std::mutex arithmetic_mutex;
+  lru_cache<std::string, std::shared_ptr<bash_ast>> arithmetic_cache(1024);
+
+  std::shared_ptr<bash_ast> get_arithmetic_ast(const std::string& expression)
+  {
+    {
+      std::lock_guard<std::mutex> l(arithmetic_mutex);
+      auto cached = arithmetic_cache.get(expression);
+      if(cached)
+        return *cached;
+    }
+
+    // Parse without holding the lock, this may throw exception
+    std::shared_ptr<bash_ast> ast(new bash_ast(std::stringstream(expression),
+                                               &bash_ast::parser_arithmetics));
+
+    std::lock_guard<std::mutex> l(arithmetic_mutex);
+    arithmetic_cache.put(expression, ast);
+    return ast;
+  }
+}
+
 long interpreter::eval_arithmetic(const std::string& expression)
 {
-  bash_ast ast(std::stringstream(expression), &bash_ast::parser_arithmetics);
-  return ast.interpret_with(*this, &bash_ast::walker_arithmetics);
+  return get_arithmetic_ast(expression)->interpret_with(*this, &bash_ast::walker_arithmetics);
 }
 
 int interpreter::shift(int shift_number)
 {
-  auto parameters = resolve_variable("*");
+  auto parameters = resolve_variable_for_write("*");
   if(shift_number < 0)
     return 1;
 
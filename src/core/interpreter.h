@@ -24,21 +24,262 @@
 #ifndef LIBBASH_CORE_INTERPRETER_H_
 #define LIBBASH_CORE_INTERPRETER_H_
 
+#include <bitset>
+#include <deque>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <string>
+#include <unordered_set>
 
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/utility.hpp>
 #include <boost/xpressive/xpressive.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 
 #include "core/function.h"
+#include "core/glob_pattern.h"
+#include "core/lru_cache.hpp"
+#include "core/symbol_ids.h"
 #include "core/symbols.hpp"
 #include "cppbash_builtin.h"
 
+class file_status_cache;
+
 /// \brief symbol table implementation
 typedef std::unordered_map<std::string, std::shared_ptr<variable>> scope;
 
+///
+/// \class layered_scope
+/// \brief the global symbol table. Variables live in an immutable layer
+///        that can be shared by many interpreters and a private overlay
+///        that holds the variables written by this interpreter. A variable
+///        in the shared layer is copied into the overlay before it's
+///        modified.
+///
+class layered_scope
+{
+  /// \brief the shared layer, never modified after it's created
+  std::shared_ptr<const scope> base;
+
+  /// \brief variables defined or modified since the last freeze
+  scope overlay;
+
+  /// \brief names in the shared layer that have been unset
+  std::unordered_set<std::string> removed;
+
+  bool is_hidden(const std::string& name) const
+  {
+    return overlay.count(name) || removed.count(name);
+  }
+
+public:
+  ///
+  /// \class const_iterator
+  /// \brief iterates the overlay and then the visible part of the shared
+  ///        layer
+  ///
+  class const_iterator: public std::iterator<std::forward_iterator_tag, const scope::value_type>
+  {
+    const layered_scope* table;
+    scope::const_iterator current;
+    bool in_overlay;
+
+    void skip_hidden()
+    {
+      if(in_overlay && current == table->overlay.end())
+      {
+        in_overlay = false;
+        current = table->base->begin();
+      }
+      while(!in_overlay && current != table->base->end() && table->is_hidden(current->first))
+        ++current;
+    }
+
+  public:
+    /// \brief constructor
+    /// \param t the symbol table
+    /// \param iter the position
+    /// \param overlay whether the position is in the overlay
+    const_iterator(const layered_scope* t, scope::const_iterator iter, bool overlay):
+      table(t), current(iter), in_overlay(overlay)
+    {
+      skip_hidden();
+    }
+
+    /// \brief dereference operator
+    /// \return the name and the variable
+    const scope::value_type& operator*() const
+    {
+      return *current;
+    }
+
+    /// \brief member access operator
+    /// \return the pointer to the name and the variable
+    const scope::value_type* operator->() const
+    {
+      return &*current;
+    }
+
+    /// \brief prefix increment operator
+    /// \return the iterator itself
+    const_iterator& operator++()
+    {
+      ++current;
+      skip_hidden();
+      return *this;
+    }
+
+    /// \brief postfix increment operator
+    /// \return the iterator before the increment
+    const_iterator operator++(int)
+    {
+      const_iterator result(*this);
+      ++*this;
+      return result;
+    }
+
+    /// \brief equality operator
+    /// \param other the iterator to compare with
+    /// \return whether they refer to the same position
+    bool operator==(const const_iterator& other) const
+    {
+      return in_overlay == other.in_overlay && current == other.current;
+    }
+
+    /// \brief inequality operator
+    /// \param other the iterator to compare with
+    /// \return whether they refer to different positions
+    bool operator!=(const const_iterator& other) const
+    {
+      return !(*this == other);
+    }
+  };
+
+  /// \brief constructor, creates an empty table
+  layered_scope(): base(new scope) {}
+
+  /// \brief create a table that starts from the content of another table.
+  ///        It's cheap when the other table is frozen.
+  /// \param other the table to start from
+  layered_scope(const layered_scope& other): base(other.base)
+  {
+    if(other.overlay.empty() && other.removed.empty())
+      return;
+
+    // The variables in the overlay of the other table are still modified
+    // in place, so we need our own copies of them
+    std::shared_ptr<scope> merged(new scope);
+    for(auto iter = other.begin(); iter != other.end(); ++iter)
+    {
+      if(other.overlay.count(iter->first))
+      {
+        auto& var = (*merged)[iter->first];
+        var.reset(new variable(*iter->second));
+        var->fill_caches();
+      }
+      else
+      {
+        (*merged)[iter->first] = iter->second;
+      }
+    }
+    base = merged;
+  }
+
+  /// \brief move all variables into a new shared layer so that the table
+  ///        can be copied without copying variables
+  void freeze()
+  {
+    if(overlay.empty() && removed.empty())
+      return;
+
+    // Values in the shared layer must not be converted lazily, because
+    // they may be read by several threads
+    BOOST_FOREACH(auto& member, overlay)
+      member.second->fill_caches();
+
+    std::shared_ptr<scope> merged(new scope(overlay));
+    BOOST_FOREACH(auto& member, *base)
+      if(!is_hidden(member.first))
+        merged->insert(member);
+    base = merged;
+    overlay.clear();
+    removed.clear();
+  }
+
+  /// \brief look up a variable for reading
+  /// \param name the name of the variable
+  /// \return the variable, null if it's not defined. The pointer is valid
+  ///         until the variable is replaced or removed
+  variable* find(const std::string& name) const
+  {
+    auto iter = overlay.find(name);
+    if(iter != overlay.end())
+      return iter->second.get();
+    if(removed.count(name))
+      return 0;
+    iter = base->find(name);
+    return iter == base->end() ? 0 : iter->second.get();
+  }
+
+  /// \brief look up a variable for writing, a variable in the shared
+  ///        layer will be copied into the overlay
+  /// \param name the name of the variable
+  /// \return the variable, null if it's not defined. The pointer is valid
+  ///         until the variable is replaced or removed
+  variable* find_for_write(const std::string& name)
+  {
+    auto iter = overlay.find(name);
+    if(iter != overlay.end())
+      return iter->second.get();
+
+    auto shared = find(name);
+    if(!shared)
+      return 0;
+    return (overlay[name] = std::make_shared<variable>(*shared)).get();
+  }
+
+  /// \brief define or replace a variable
+  /// \param name the name of the variable
+  /// \param var the variable
+  void set(const std::string& name, const std::shared_ptr<variable>& var)
+  {
+    overlay[name] = var;
+    removed.erase(name);
+  }
+
+  /// \brief remove a variable
+  /// \param name the name of the variable
+  void erase(const std::string& name)
+  {
+    overlay.erase(name);
+    if(base->count(name))
+      removed.insert(name);
+  }
+
+  /// \brief get the number of variables
+  /// \return the number of variables
+  scope::size_type size() const
+  {
+    return static_cast<scope::size_type>(std::distance(begin(), end()));
+  }
+
+  /// \brief get an iterator referring to the first variable
+  /// \return the iterator
+  const_iterator begin() const
+  {
+    return const_iterator(this, overlay.begin(), true);
+  }
+
+  /// \brief get an iterator referring to the position after the last variable
+  /// \return the iterator
+  const_iterator end() const
+  {
+    return const_iterator(this, base->end(), false);
+  }
+};
+
 ///
 /// \class interpreter
 /// \brief implementation for bash interpreter
@@ -47,16 +288,44 @@ class interpreter: public boost::noncopyable
 {
 
   /// \brief global symbol table for variables
-  scope members;
+  layered_scope members;
 
   /// \brief global symbol table for functions
   std::unordered_map<std::string, function> functions;
 
   std::stack<bash_ast*> ast_stack;
 
-  /// \brief local scope for function arguments, execution environment and
-  ///        local variables
-  std::vector<scope> local_members;
+  /// \brief a local scope for function arguments, execution environment
+  ///        and local variables
+  struct local_frame
+  {
+    /// ids of the variables defined in the scope
+    std::vector<unsigned> symbols;
+    /// storage of the variables defined in the scope, they are released
+    /// together when the scope ends
+    std::deque<variable> variables;
+  };
+
+  /// \brief a variable defined in a local scope
+  struct local_binding
+  {
+    /// the depth of the local scope, starting from 1
+    std::vector<local_frame>::size_type depth;
+    /// the variable, owned by the local scope
+    variable* var;
+  };
+
+  /// \brief local scopes. Only the first local_depth entries are in use,
+  ///        the rest are kept to reuse their memory.
+  std::vector<local_frame> local_members;
+
+  /// \brief the number of active local scopes
+  std::vector<local_frame>::size_type local_depth;
+
+  /// \brief local variables by symbol id, the innermost one is the last.
+  ///        So resolving a name doesn't depend on the call depth. Only the
+  ///        names defined as local variables have entries.
+  std::unordered_map<unsigned, std::vector<local_binding>> local_bindings;
 
   std::ostream* _out;
 
@@ -74,6 +343,23 @@ class interpreter: public boost::noncopyable
   /// \brief the return status of the last command
   int status;
 
+  /// \brief the value of IFS that ifs_table was built from
+  mutable std::string ifs_value;
+
+  /// \brief whether each character is in IFS, used by word splitting
+  mutable std::bitset<256> ifs_table;
+
+  /// \brief compiled patterns that contain expansions, keyed by the anchor,
+  ///        the greediness and the expanded source text
+  lru_cache<std::string, std::shared_ptr<const glob_pattern>> pattern_cache;
+
+  /// \brief compiled regular expressions of [[ =~ ]], keyed by their text
+  lru_cache<std::string, std::shared_ptr<const boost::xpressive::sregex>> regex_cache;
+
+  /// \brief the cache of file status used by the file test operators, null
+  ///        when file status is not cached
+  std::shared_ptr<file_status_cache> file_statuses;
+
   /// \brief calculate the correct offset when offset < 0 and check whether
   ///        the real offset is in legal range
   /// \param[in,out] offset a value/result argument referring to offset
@@ -85,14 +371,25 @@ class interpreter: public boost::noncopyable
     return !(offset < 0 || offset >= size);
   }
 
+  std::string get_ifs_delimiter() const;
+
   void get_all_elements_joined(const std::string& name,
                                const std::string& delim,
                                std::string& result) const;
 
-  std::shared_ptr<variable> resolve_variable(const std::string&) const;
+  variable* resolve_local_variable(const std::string& name, symbol_id id=symbol_id()) const;
+
+  variable* resolve_variable(const std::string& name, symbol_id id=symbol_id()) const;
 
-  void define_function_arguments(scope& current_stack,
-                                 const std::vector<std::string>& arguments);
+  variable* resolve_variable_for_write(const std::string& name, symbol_id id=symbol_id());
+
+  void define_local_variable(const std::string& name, variable&& var, symbol_id id=symbol_id());
+
+  void push_local_scope();
+
+  void pop_local_scope();
+
+  void define_function_arguments(const std::vector<std::string>& arguments);
 
   std::string get_substring(const std::string& name,
                             long long offset,
@@ -120,19 +417,27 @@ public:
     /// \param w the reference to the interpreter object
     local_scope(interpreter& w): walker(w)
     {
-      walker.local_members.push_back(scope());
+      walker.push_local_scope();
     }
 
     /// \brief the destructor
     ~local_scope()
     {
-      walker.local_members.pop_back();
+      walker.pop_local_scope();
     }
   };
 
   /// \brief construtor
   interpreter();
 
+  /// \brief create an interpreter that starts from the state of another
+  ///        interpreter, including variables, functions and options.
+  ///        Global variables are shared until they are modified. Freeze
+  ///        the base interpreter first to avoid copying its variables.
+  ///        Functions keep referring to the ASTs they were defined in.
+  /// \param base_interpreter the interpreter to clone
+  explicit interpreter(const std::shared_ptr<const interpreter>& base_interpreter);
+
   ///
   /// \brief return the number of variables
   /// \return the number of variables
@@ -141,47 +446,37 @@ public:
     return members.size();
   }
 
-  ///
-  /// \brief return an iterator referring to the first variable
-  /// \return iterator referring to the first variable
-  scope::iterator begin()
-  {
-    return members.begin();
-  }
-
   ///
   /// \brief return a const iterator referring to the first variable
   /// \return const iterator referring to the first variable
-  scope::const_iterator begin() const
+  layered_scope::const_iterator begin() const
   {
     return members.begin();
   }
 
-  ///
-  /// \brief return an iterator referring to the next element after the
-  ///        last variable
-  /// \return iterator referring to he next element after the last variable
-  scope::iterator end()
-  {
-    return members.end();
-  }
-
   ///
   /// \brief return a const iterator referring to the next element after
   ///        the last variable
   /// \return const iterator referring to he next element after the last
   ///         variable
-  scope::const_iterator end() const
+  layered_scope::const_iterator end() const
   {
     return members.end();
   }
 
+  /// \brief move the global variables into a layer that is shared with
+  ///        the interpreters cloned from this one afterwards
+  void freeze()
+  {
+    members.freeze();
+  }
+
   ///
   /// \brief checks whether the current scope is local or global
   /// \return whether current scope is local
   bool is_local_scope() const
   {
-    return local_members.size() > 0;
+    return local_depth > 0;
   }
 
   /// \brief set current output stream
@@ -235,7 +530,7 @@ public:
   /// \brief check whether a variable is valid and can be used
   /// \param var variable
   /// \return whether the variable is valid
-  bool is_valid(const std::shared_ptr<variable>& var, const std::string& name) const
+  bool is_valid(const variable* var, const std::string& name) const
   {
     if(var)
       return true;
@@ -250,31 +545,38 @@ public:
   ///        checked first, then global scope
   /// \param name variable name
   /// \param index array index, use index=0 if it's not an array
+  /// \param id the symbol id of the name if it's resolved in advance
   /// \return the value of the variable, call default constructor if
   ///         it's undefined
   template <typename T>
-  T resolve(const std::string& name, const unsigned index=0) const
+  T resolve(const std::string& name, const unsigned index=0, symbol_id id=symbol_id()) const
   {
-    auto var = resolve_variable(name);
-    if(is_valid(var, name))
-    {
-      if(get_option('u') && var->is_unset(index))
-      {
-        if(name == "*")
-          throw libbash::unsupported_exception("$" + boost::lexical_cast<std::string>(index) + ": unbound variable");
-        else if(index == 0)
-          throw libbash::unsupported_exception(name + ": unbound variable");
-        else
-          throw libbash::unsupported_exception(name + "[" + boost::lexical_cast<std::string>(index) + "]: unbound variable");
-      }
-      return var->get_value<T>(index);
-    }
-    else
+    auto var = resolve_set_variable(name, index, id);
+    return var ? var->get_value<T>(index) : T{};
+  }
+
+  /// \brief resolve a variable for reading its value, raise
+  ///        libbash::unsupported_exception for unbound variables if the u
+  ///        option is enabled
+  /// \param name variable name
+  /// \param index array index, use index=0 if it's not an array
+  /// \param id the symbol id of the name if it's resolved in advance
+  /// \return the variable, null if it's undefined
+  const variable* resolve_set_variable(const std::string& name,
+                                       const unsigned index,
+                                       symbol_id id=symbol_id()) const
+  {
+    auto var = resolve_variable(name, id);
+    if(is_valid(var, name) && get_option('u') && var->is_unset(index))
     {
-      if(get_option('u'))
+      if(name == "*")
+        throw libbash::unsupported_exception("$" + boost::lexical_cast<std::string>(index) + ": unbound variable");
+      else if(index == 0)
         throw libbash::unsupported_exception(name + ": unbound variable");
-      return T{};
+      else
+        throw libbash::unsupported_exception(name + "[" + boost::lexical_cast<std::string>(index) + "]: unbound variable");
     }
+    return var;
   }
 
   /// \brief resolve array variable
@@ -295,15 +597,18 @@ public:
   ///        if the variable is undefined
   /// \param name variable name
   /// \param index array index, use index=0 if it's not an array
+  /// \param id the symbol id of the name if it's resolved in advance
   /// \return whether the value of the variable is null
-  bool is_unset_or_null(const std::string& name, const unsigned index) const;
+  bool is_unset_or_null(const std::string& name,
+                        const unsigned index,
+                        symbol_id id=symbol_id()) const;
 
   /// \brief check whether the value of the variable is unset
   /// \param name variable name
   /// \return whether the value of the variable is unset
   bool is_unset(const std::string& name) const
   {
-    return members.find(name) == members.end();
+    return !members.find(name);
   }
 
   /// \brief update the variable value, raise libbash::interpreter_exception if
@@ -311,13 +616,15 @@ public:
   /// \param name variable name
   /// \param new_value new value
   /// \param index array index, use index=0 if it's not an array
+  /// \param id the symbol id of the name if it's resolved in advance
   /// \return the new value of the variable
   template <typename T>
   const T& set_value(const std::string& name,
                      const T& new_value,
-                     const unsigned index=0)
+                     const unsigned index=0,
+                     symbol_id id=symbol_id())
   {
-    auto var = resolve_variable(name);
+    auto var = resolve_variable_for_write(name, id);
     if(var)
       var->set_value(new_value, index);
     else
@@ -362,7 +669,7 @@ public:
               bool readonly=false,
               const unsigned index=0)
   {
-    members[name].reset(new variable(name, value, readonly, index));
+    members.set(name, std::make_shared<variable>(name, value, readonly, index));
   }
 
   /// \brief define a new local variable
@@ -370,15 +677,17 @@ public:
   /// \param value the value of the variable
   /// \param readonly whether it's readonly, default is false
   /// \param index whether it's null, default is false
+  /// \param id the symbol id of the name if it's resolved in advance
   template <typename T>
   void define_local(const std::string& name,
                     const T& value,
                     bool readonly=false,
-                    const unsigned index=0)
+                    const unsigned index=0,
+                    symbol_id id=symbol_id())
   {
-    if(local_members.empty())
+    if(local_depth == 0)
       throw libbash::runtime_exception("Define local variables outside function scope");
-    local_members.back()[name].reset(new variable(name, value, readonly, index));
+    define_local_variable(name, variable(name, value, readonly, index), id);
   }
 
   /// \brief define a new function
@@ -387,6 +696,12 @@ public:
   void define_function(const std::string& name,
                        ANTLR3_MARKER body_index);
 
+  /// \brief define a new function whose body is parsed on the first call
+  /// \param name the name of the function
+  /// \param lazy_body the LAZY_FUNCTION_BODY node of the function
+  void define_lazy_function(const std::string& name,
+                            pANTLR3_BASE_TREE lazy_body);
+
   /// \brief push current AST, used for function definition
   /// \param ast the pointer to the current ast
   void push_current_ast(bash_ast* ast)
@@ -400,6 +715,50 @@ public:
     ast_stack.pop();
   }
 
+  /// \brief get a compiled pattern. Patterns are cached by their source
+  ///        text so expanding to the same text doesn't compile again.
+  /// \param source the source text of the pattern
+  /// \param greedy whether wildcards match as much as possible
+  /// \param anchor how the pattern is applied to the value
+  /// \return the compiled pattern
+  std::shared_ptr<const glob_pattern> get_glob_pattern(const std::string& source,
+                                                       bool greedy,
+                                                       glob_pattern::anchor_type anchor);
+
+  /// \brief match a value against a regular expression like
+  ///        [[ value =~ regex ]] and store the match and the sub matches in
+  ///        BASH_REMATCH. Compiled expressions are cached by their text.
+  /// \param value the value to be matched
+  /// \param regex the text of the regular expression
+  /// \return whether the regex matches any part of the value
+  bool match_regex(const std::string& value, const std::string& regex);
+
+  /// \brief cache the file status used by the file test operators. The
+  ///        cache is shared with the interpreters cloned from this one.
+  /// \param cache the cache to use, null to query the file system directly
+  void set_file_status_cache(const std::shared_ptr<file_status_cache>& cache)
+  {
+    file_statuses = cache;
+  }
+
+  /// \brief get the cache of file status
+  /// \return the cache, null if file status is not cached
+  file_status_cache* get_file_status_cache() const
+  {
+    return file_statuses.get();
+  }
+
+  /// \brief forget the cached status of a file that is about to be written
+  /// \param path the path of the file
+  void invalidate_file_status(const std::string& path);
+
+  /// \brief get the AST that is being interpreted
+  /// \return the reference to the current AST
+  bash_ast& get_current_ast()
+  {
+    return *ast_stack.top();
+  }
+
   /// \brief make function call
   /// \param name function name
   /// \param arguments function arguments
@@ -567,6 +926,46 @@ public:
   ///.\param[out] output the splitted result will be appended to output
   void split_word(const std::string& word, std::vector<std::string>& output) const;
 
+  ///
+  /// \class field_splitter
+  /// \brief splits words into fields one at a time
+  ///
+  class field_splitter
+  {
+    std::bitset<256> delimiters;
+
+  public:
+    /// \brief constructor
+    /// \param table whether each character is a delimiter
+    explicit field_splitter(const std::bitset<256>& table): delimiters(table) {}
+
+    /// \brief find the next field of a word. Leading and trailing
+    ///        delimiters are dropped and consecutive delimiters are treated
+    ///        as one.
+    /// \param word the word to split
+    /// \param[in,out] position where the search starts, moved past the
+    ///                 returned field
+    /// \param[out] field the field
+    /// \return whether a field is found
+    bool next(const std::string& word, std::string::size_type& position, std::string& field) const
+    {
+      while(position != word.size() && delimiters[static_cast<unsigned char>(word[position])])
+        ++position;
+      if(position == word.size())
+        return false;
+
+      auto start = position;
+      while(position != word.size() && !delimiters[static_cast<unsigned char>(word[position])])
+        ++position;
+      field.assign(word, start, position - start);
+      return true;
+    }
+  };
+
+  /// \brief get a splitter that uses the current value of IFS
+  /// \return the splitter
+  field_splitter get_field_splitter() const;
+
   /// \brief get the status of shell optional behavior
   /// \param name the option name
   /// \return zero unless the name is not a valid shell option
@@ -617,26 +1016,27 @@ public:
   void define_positional_arguments(const std::vector<std::string>::const_iterator begin,
                                    const std::vector<std::string>::const_iterator end);
 
-  /// \brief perform expansion like ${var//foo/bar}
+  /// \brief perform expansion like ${var//foo/bar}. Anchored patterns
+  ///        are replaced at most once, like ${var/#foo/bar}.
   /// \param value the value to be expanded
   /// \param pattern the pattern used to match the value
   /// \param replacement the replacement string
   static void replace_all(std::string& value,
-                          const boost::xpressive::sregex& pattern,
+                          const glob_pattern& pattern,
                           const std::string& replacement);
 
   /// \brief perform expansion like ${var%foo}
   /// \param value the value to be expanded
-  /// \param pattern the pattern used to match the value
+  /// \param pattern the non-greedy pattern anchored at the end
   static void lazy_remove_at_end(std::string& value,
-                                 const boost::xpressive::sregex& pattern);
+                                 const glob_pattern& pattern);
 
   /// \brief perform expansion like ${var/foo/bar}
   /// \param value the value to be expanded
   /// \param pattern the pattern used to match the value
   /// \param replacement the replacement string
   static void replace_first(std::string& value,
-                            const boost::xpressive::sregex& pattern,
+                            const glob_pattern& pattern,
                             const std::string& replacement);
 
   /// \brief remove trailing EOLs from the value
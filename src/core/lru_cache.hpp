@@ -0,0 +1,110 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file lru_cache.hpp
+/// \brief a bounded cache that drops the least recently used entry
+///
+
+#ifndef LIBBASH_CORE_LRU_CACHE_HPP_
+#define LIBBASH_CORE_LRU_CACHE_HPP_
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+///
+/// \class lru_cache
+/// \brief a bounded key value cache, the least recently used entry will be
+///        dropped when the cache is full. It's not thread safe.
+///
+template<typename Key, typename Value>
+class lru_cache
+{
+  typedef std::list<std::pair<Key, Value>> entry_list;
+
+  /// \brief entries ordered from the most recently used to the least
+  entry_list entries;
+
+  std::unordered_map<Key, typename entry_list::iterator> index;
+
+  typename entry_list::size_type capacity;
+
+public:
+  /// size_type for the number of entries
+  typedef typename entry_list::size_type size_type;
+
+  /// \brief constructor
+  /// \param max_size the maximum number of entries
+  explicit lru_cache(size_type max_size): capacity(max_size) {}
+
+  /// \brief look up a cached value and mark it as recently used
+  /// \param key the key of the value
+  /// \return the pointer to the value, null if it's not cached. The pointer
+  ///         is valid until the next call to put or clear
+  Value* get(const Key& key)
+  {
+    auto iter = index.find(key);
+    if(iter == index.end())
+      return 0;
+
+    entries.splice(entries.begin(), entries, iter->second);
+    return &iter->second->second;
+  }
+
+  /// \brief cache a value, replacing the old value of the same key
+  /// \param key the key of the value
+  /// \param value the value to be cached
+  void put(const Key& key, const Value& value)
+  {
+    if(capacity == 0)
+      return;
+
+    auto iter = index.find(key);
+    if(iter != index.end())
+    {
+      iter->second->second = value;
+      entries.splice(entries.begin(), entries, iter->second);
+      return;
+    }
+
+    if(index.size() == capacity)
+    {
+      index.erase(entries.back().first);
+      entries.pop_back();
+    }
+    entries.push_front(std::make_pair(key, value));
+    index[key] = entries.begin();
+  }
+
+  /// \brief drop all entries
+  void clear()
+  {
+    index.clear();
+    entries.clear();
+  }
+
+  /// \brief get the number of cached entries
+  /// \return the number of entries
+  size_type size() const
+  {
+    return index.size();
+  }
+};
+
+#endif
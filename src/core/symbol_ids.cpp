@@ -0,0 +1,74 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file symbol_ids.cpp
+/// \brief implementation for interned variable names
+///
+
+#include "core/symbol_ids.h"
+
+#include <unordered_map>
+
+#include <pthread.h>
+
+const unsigned symbol_id::unknown_symbol;
+
+namespace
+{
+  // Names are looked up far more often than they are interned
+  pthread_rwlock_t ids_lock = PTHREAD_RWLOCK_INITIALIZER;
+  std::unordered_map<std::string, unsigned> ids;
+
+  class ids_guard
+  {
+  public:
+    explicit ids_guard(bool exclusive)
+    {
+      if(exclusive)
+        pthread_rwlock_wrlock(&ids_lock);
+      else
+        pthread_rwlock_rdlock(&ids_lock);
+    }
+
+    ~ids_guard()
+    {
+      pthread_rwlock_unlock(&ids_lock);
+    }
+  };
+}
+
+bool find_symbol_id(const std::string& name, unsigned& id)
+{
+  ids_guard read_lock(false);
+  auto iter = ids.find(name);
+  if(iter == ids.end())
+    return false;
+  id = iter->second;
+  return true;
+}
+
+unsigned get_symbol_id(const std::string& name)
+{
+  unsigned id;
+  if(find_symbol_id(name, id))
+    return id;
+
+  ids_guard write_lock(true);
+  return ids.insert(std::make_pair(name, ids.size())).first->second;
+}
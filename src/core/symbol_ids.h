@@ -0,0 +1,70 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file symbol_ids.h
+/// \brief interned integer ids for variable names
+///
+
+#ifndef LIBBASH_CORE_SYMBOL_IDS_H_
+#define LIBBASH_CORE_SYMBOL_IDS_H_
+
+#include <string>
+
+///
+/// \brief the symbol id of a variable name when it's resolved in advance,
+///        such as the names in an AST. Names are looked up otherwise.
+///
+struct symbol_id
+{
+  /// \brief the id, unknown_symbol if it's not resolved
+  unsigned value;
+
+  static const unsigned unknown_symbol = ~0u;
+
+  symbol_id(): value(unknown_symbol) {}
+
+  explicit symbol_id(unsigned id): value(id) {}
+
+  /// \brief check whether the id is resolved
+  /// \return true if the id is resolved
+  bool is_known() const
+  {
+    return value != unknown_symbol;
+  }
+};
+
+///
+/// \brief get the id of a variable name, interning the name if it has no
+///        id yet. Ids are small consecutive integers starting from zero
+///        and the same name always gets the same id in a process. Only
+///        names that are defined or appear in an AST should be interned so
+///        the table stays small. It's thread safe.
+/// \param name the variable name
+/// \return the id of the name
+unsigned get_symbol_id(const std::string& name);
+
+///
+/// \brief look up the id of a variable name without interning it. It's
+///        thread safe.
+/// \param name the variable name
+/// \param[out] id the id of the name
+/// \return false if the name has never been interned
+bool find_symbol_id(const std::string& name, unsigned& id);
+
+#endif
@@ -24,107 +24,335 @@
 #ifndef LIBBASH_CORE_SYMBOLS_HPP_
 #define LIBBASH_CORE_SYMBOLS_HPP_
 
+#include <limits>
 #include <map>
 #include <memory>
-#include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
-#include <boost/variant.hpp>
-#include <boost/lexical_cast.hpp>
 #include <boost/numeric/conversion/cast.hpp>
 
 #include "exceptions.h"
 
 ///
-/// \class converter
-/// \brief template class of converter
+/// \class dual_value
+/// \brief a value that can be read as a string or an integer. The
+///        representation that wasn't assigned is converted on first use and
+///        cached until the next assignment.
 ///
-template<typename T>
-class converter: public boost::static_visitor<T>
-{};
-
-///
-/// \class converter
-/// \brief specialized converter for long
-///
-template<>
-class converter<long>: public boost::static_visitor<long>
+class dual_value
 {
-public:
-  /// \brief converter for long value
-  /// \param value the value to be converted
-  /// \return the converted long
-  long operator() (const long value) const
+  enum
   {
-    return value;
-  }
+    text_valid = 1,
+    number_valid = 2
+  };
+
+  mutable std::string text;
+
+  mutable long number;
 
-  /// \brief converter for string value
-  /// \param value the value to be converted
-  /// \return the converted long
-  long operator() (const std::string& value) const
+  /// \brief the valid representations
+  mutable unsigned char valid;
+
+  static std::string to_string(long value)
   {
-    long result = 0;
-    try
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    char* begin = end;
+    unsigned long magnitude = value < 0 ? 0ul - static_cast<unsigned long>(value)
+                                        : static_cast<unsigned long>(value);
+    do
     {
-      result = boost::lexical_cast<long>(value);
+      *--begin = static_cast<char>('0' + magnitude % 10);
+      magnitude /= 10;
     }
-    catch(boost::bad_lexical_cast& e)
+    while(magnitude);
+    if(value < 0)
+      *--begin = '-';
+    return std::string(begin, end);
+  }
+
+  /// \brief the strings that are not decimal integers are converted to 0
+  static long to_long(const std::string& value)
+  {
+    auto iter = value.begin();
+    bool negative = false;
+    if(iter != value.end() && (*iter == '-' || *iter == '+'))
+      negative = (*iter++ == '-');
+    if(iter == value.end())
+      return 0;
+
+    unsigned long limit = negative ? 0ul - static_cast<unsigned long>(std::numeric_limits<long>::min())
+                                   : std::numeric_limits<long>::max();
+    unsigned long result = 0;
+    for(; iter != value.end(); ++iter)
     {
-      std::cerr << "can't cast " << value << " to long" << std::endl;
+      if(*iter < '0' || *iter > '9')
+        return 0;
+      unsigned digit = static_cast<unsigned>(*iter - '0');
+      if(result > (limit - digit) / 10)
+        return 0;
+      result = result * 10 + digit;
     }
-    return result;
+    return negative ? static_cast<long>(0ul - result) : static_cast<long>(result);
   }
-};
 
-///
-/// \class converter
-/// \brief specialized converter for string
-///
-template<>
-class converter<std::string>:
-  public boost::static_visitor<std::string>
-{
 public:
-  /// \brief converter for long value
-  /// \param value the value to be converted
-  /// \return the converted string
-  std::string operator() (const long value) const
+  /// \brief constructor, creates an empty string
+  dual_value(): number(0), valid(text_valid) {}
+
+  /// \brief constructor
+  /// \param value the string value
+  dual_value(const std::string& value): text(value), number(0), valid(text_valid) {}
+
+  /// \brief constructor
+  /// \param value the string value
+  dual_value(const char* value): text(value), number(0), valid(text_valid) {}
+
+  /// \brief constructor
+  /// \param value the integer value
+  template<typename T>
+  dual_value(T value, typename std::enable_if<std::is_integral<T>::value>::type* = 0):
+    number(static_cast<long>(value)), valid(number_valid) {}
+
+  /// \brief get the value
+  /// \return the value converted to T
+  template<typename T>
+  T get() const;
+
+  /// \brief get the string representation without copying it
+  /// \return the reference to the string, valid until the next assignment
+  const std::string& get_string() const
   {
-    return boost::lexical_cast<std::string>(value);
+    if(!(valid & text_valid))
+    {
+      text = to_string(number);
+      valid |= text_valid;
+    }
+    return text;
+  }
+
+  /// \brief get the length of the string representation, an integer is
+  ///        measured without converting it
+  /// \return the length
+  std::string::size_type get_length() const
+  {
+    if(valid & text_valid)
+      return text.size();
+
+    std::string::size_type length = number < 0 ? 2 : 1;
+    for(long rest = number / 10; rest != 0; rest /= 10)
+      ++length;
+    return length;
   }
 
-  /// \brief converter for string value
-  /// \param value the value to be converted
-  /// \return the converted string
-  std::string operator() (const std::string& value) const
+  /// \brief check whether the string representation is empty
+  /// \return whether the value is an empty string
+  bool is_empty() const
   {
-    return value;
+    return (valid & text_valid) ? text.empty() : false;
   }
+
+  /// \brief convert the value to all representations so that it can be
+  ///        read by several threads without being modified
+  void fill_caches() const;
 };
 
+/// \brief get the string representation
+/// \return the string
+template<>
+inline std::string dual_value::get<std::string>() const
+{
+  return get_string();
+}
+
+/// \brief get the integer representation
+/// \return the integer, 0 if the string is not a decimal integer
+template<>
+inline long dual_value::get<long>() const
+{
+  if(!(valid & number_valid))
+  {
+    number = to_long(text);
+    valid |= number_valid;
+  }
+  return number;
+}
+
+inline void dual_value::fill_caches() const
+{
+  get<std::string>();
+  get<long>();
+}
+
 ///
 /// \class variable
 /// \brief implementation for all variable types
 ///
 class variable
 {
+  /// \brief the value of a single element
+  typedef dual_value element;
+
+  /// \brief how the elements are stored
+  enum storage
+  {
+    /// at most one element at index 0, kept in scalar_value
+    scalar_storage,
+    /// contiguous elements starting at dense_begin, kept in dense_values
+    dense_storage,
+    /// any other elements, kept in sparse_values
+    sparse_storage
+  };
+
   /// \brief variable name
   std::string name;
 
-  /// \brief actual value of the variable. We put string in front of long
-  ///        because we want "" as default string value; Otherwise we
-  ///        will get "0".
-  std::map<unsigned, boost::variant<std::string, long>> value;
+  storage layout;
+
+  /// \brief whether scalar_value is set
+  bool scalar_set;
+
+  element scalar_value;
+
+  /// \brief the index of the first element in dense_values
+  unsigned dense_begin;
+
+  std::vector<element> dense_values;
+
+  /// \brief the number of elements at the front of dense_values that have
+  ///        been removed by shift or unset. They are dropped lazily so that
+  ///        removing the first element takes constant time.
+  std::vector<element>::size_type dense_skip;
+
+  std::vector<element>::size_type dense_size() const
+  {
+    return dense_values.size() - dense_skip;
+  }
+
+  std::map<unsigned, element> sparse_values;
 
   /// \brief whether the variable is readonly
   bool readonly;
 
+  /// \brief find an element
+  /// \param index the index of the element
+  /// \return the pointer to the element, null if it's unset
+  const element* find_element(const unsigned index) const
+  {
+    switch(layout)
+    {
+      case scalar_storage:
+        return (index == 0 && scalar_set) ? &scalar_value : 0;
+      case dense_storage:
+        if(index < dense_begin || index - dense_begin >= dense_size())
+          return 0;
+        return &dense_values[dense_skip + index - dense_begin];
+      default:
+        auto iter = sparse_values.find(index);
+        return iter == sparse_values.end() ? 0 : &iter->second;
+    }
+  }
+
+  /// \brief call the function for every element in index order
+  /// \param f the function taking an index and an element
+  template<typename F>
+  void for_each_element(F f) const
+  {
+    switch(layout)
+    {
+      case scalar_storage:
+        if(scalar_set)
+          f(0u, scalar_value);
+        break;
+      case dense_storage:
+        for(unsigned i = 0; i != dense_size(); ++i)
+          f(dense_begin + i, dense_values[dense_skip + i]);
+        break;
+      default:
+        for(auto iter = sparse_values.begin(); iter != sparse_values.end(); ++iter)
+          f(iter->first, iter->second);
+    }
+  }
+
+  /// \brief move all elements into sparse_values
+  void make_sparse()
+  {
+    std::map<unsigned, element> values;
+    for_each_element([&](unsigned index, const element& e) { values.insert(values.end(), std::make_pair(index, e)); });
+    sparse_values.swap(values);
+    scalar_set = false;
+    dense_values.clear();
+    dense_skip = 0;
+    layout = sparse_storage;
+  }
+
+  /// \brief store an element, the layout is changed when needed
+  /// \param index the index of the element
+  /// \param e the element
+  void set_element(const unsigned index, const element& e)
+  {
+    if(layout == scalar_storage)
+    {
+      if(index == 0)
+      {
+        scalar_value = e;
+        scalar_set = true;
+        return;
+      }
+      if(scalar_set && index != 1)
+      {
+        make_sparse();
+        sparse_values[index] = e;
+        return;
+      }
+
+      layout = dense_storage;
+      dense_begin = scalar_set ? 0 : index;
+      if(scalar_set)
+        dense_values.push_back(scalar_value);
+      scalar_set = false;
+    }
+
+    if(layout == dense_storage)
+    {
+      if(dense_size() == 0)
+      {
+        dense_values.clear();
+        dense_skip = 0;
+        dense_begin = index;
+      }
+      if(index >= dense_begin && index - dense_begin < dense_size())
+      {
+        dense_values[dense_skip + index - dense_begin] = e;
+        return;
+      }
+      if(index - dense_begin == dense_size() && index >= dense_begin)
+      {
+        dense_values.push_back(e);
+        return;
+      }
+      make_sparse();
+    }
+
+    sparse_values[index] = e;
+  }
+
+  /// \brief store the elements of an array
+  /// \param values the elements
+  template<typename T>
+  void set_elements(const std::map<unsigned, T>& values)
+  {
+    for(auto iter = values.begin(); iter != values.end(); ++iter)
+      set_element(iter->first, iter->second);
+  }
+
 public:
   /// size_type for array length
-  typedef std::map<unsigned, boost::variant<std::string, long>>::size_type size_type;
+  typedef std::map<unsigned, element>::size_type size_type;
 
   /// \brief retrieve variable name
   /// \return const string value of variable name
@@ -143,9 +371,9 @@ public:
            const T& v,
            bool ro=false,
            const unsigned index=0)
-    : name(name), readonly(ro)
+    : name(name), layout(scalar_storage), scalar_set(false), dense_begin(0), dense_skip(0), readonly(ro)
   {
-    value[index] = v;
+    set_element(index, element(v));
   }
 
   /// \brief retrieve actual value of the variable, if index is out of bound,
@@ -155,13 +383,23 @@ public:
   template<typename T>
   T get_value(const unsigned index=0) const
   {
-    static converter<T> visitor;
-
-    auto iter = value.find(index);
-    if(iter == value.end())
+    const element* e = find_element(index);
+    if(!e)
         return T{};
 
-    return boost::apply_visitor(visitor, iter->second);
+    return e->get<T>();
+  }
+
+  /// \brief retrieve the string value of the variable without copying it
+  /// \param index the index of the variable, use 0 if it's not an array
+  /// \return the reference to the value, valid until the variable is
+  ///         modified. An empty string if index is out of bound
+  const std::string& get_string(const unsigned index=0) const
+  {
+    static const std::string empty;
+
+    const element* e = find_element(index);
+    return e ? e->get_string() : empty;
   }
 
   /// \brief retrieve all values of the array
@@ -169,13 +407,20 @@ public:
   template<typename T>
   void get_all_values(std::vector<T>& all_values) const
   {
-    static converter<T> visitor;
-
-    for(auto iter = value.begin(); iter != value.end(); ++iter)
-        all_values.push_back(
-                boost::apply_visitor(visitor, iter->second));
+    all_values.reserve(all_values.size() + get_array_length());
+    for_each_element([&](unsigned, const element& e) {
+      all_values.push_back(e.get<T>());
+    });
   }
 
+  /// \brief call the function with the string value of every element in
+  ///        index order, without copying the values
+  /// \param f the function taking a const std::string&
+  template<typename F>
+  void for_each_string(F f) const
+  {
+    for_each_element([&](unsigned, const element& e) { f(e.get_string()); });
+  }
 
   /// \brief set the value of the variable, raise exception if it's readonly
   /// \param new_value the new value to be set
@@ -187,7 +432,7 @@ public:
     if(readonly)
       throw libbash::readonly_exception(get_name() + " is readonly variable");
 
-    value[index] = new_value;
+    set_element(index, element(new_value));
   }
 
   /// \brief unset the variable, only used for array variable
@@ -197,7 +442,40 @@ public:
     if(readonly)
       throw libbash::readonly_exception(get_name() + " is readonly variable");
 
-    value.erase(index);
+    switch(layout)
+    {
+      case scalar_storage:
+        if(index == 0)
+          scalar_set = false;
+        break;
+      case dense_storage:
+        if(!find_element(index))
+          break;
+        if(index - dense_begin == dense_size() - 1)
+        {
+          dense_values.pop_back();
+        }
+        else if(index == dense_begin)
+        {
+          ++dense_skip;
+          ++dense_begin;
+        }
+        else
+        {
+          make_sparse();
+          sparse_values.erase(index);
+        }
+        break;
+      default:
+        sparse_values.erase(index);
+    }
+  }
+
+  /// \brief convert all elements to all representations so that the
+  ///        variable can be read by several threads without being modified
+  void fill_caches() const
+  {
+    for_each_element([](unsigned, const element& e) { e.fill_caches(); });
   }
 
   /// \brief get the length of a variable
@@ -205,33 +483,51 @@ public:
   /// \return the length of the variable
   std::string::size_type get_length(const unsigned index=0) const
   {
-    return get_value<std::string>(index).size();
+    const element* e = find_element(index);
+    return e ? e->get_length() : 0;
   }
 
   /// \brief get the length of an array variable
   /// \return the length of the array
   size_type get_array_length() const
   {
-    return value.size();
+    switch(layout)
+    {
+      case scalar_storage:
+        return scalar_set ? 1 : 0;
+      case dense_storage:
+        return dense_size();
+      default:
+        return sparse_values.size();
+    }
   }
 
   size_type get_max_index() const
   {
-    return value.size() == 0 ? 0 : value.rbegin()->first;
+    switch(layout)
+    {
+      case scalar_storage:
+        return 0;
+      case dense_storage:
+        return dense_size() == 0 ? 0 : dense_begin + dense_size() - 1;
+      default:
+        return sparse_values.empty() ? 0 : sparse_values.rbegin()->first;
+    }
   }
 
   /// \brief check whether the value of the variable is null
   /// \return whether the value of the variable is null
   bool is_unset(const unsigned index=0) const
   {
-    return value.find(index) == value.end();
+    return !find_element(index);
   }
 
   /// \brief check whether the value of the variable is unset
   /// \return whether the value of the variable is unset
   bool is_null(const unsigned index=0) const
   {
-    return get_value<std::string>(index) == "";
+    const element* e = find_element(index);
+    return !e || e->is_empty();
   }
 
   /// \brief check whether the value of the variable is readonly
@@ -245,7 +541,7 @@ public:
   {
     assert(!readonly&&"readonly variables shouldn't be shifted");
     // Remove this cast after making arithmetic expansion follow POSIX
-    unsigned size = boost::numeric_cast<unsigned>(value.size());
+    unsigned size = boost::numeric_cast<unsigned>(get_array_length());
 
     if(shift_number > size) 
     {
@@ -253,17 +549,34 @@ public:
     }
     else if(shift_number == size)
     {
-      value.clear();
+      scalar_set = false;
+      dense_values.clear();
+      dense_skip = 0;
+      sparse_values.clear();
     }
-    else
+    else if(layout == dense_storage)
+    {
+      // Shifting renumbers the elements: index dense_begin + i now refers
+      // to dense_values[dense_skip + i]. The shifted out elements are
+      // dropped once they take half of the storage
+      dense_skip += shift_number;
+      if(dense_skip > dense_values.size() / 2)
+      {
+        typedef std::vector<element>::difference_type difference_type;
+        dense_values.erase(dense_values.begin(),
+                           dense_values.begin() + static_cast<difference_type>(dense_skip));
+        dense_skip = 0;
+      }
+    }
+    else if(layout == sparse_storage)
     {
       // copy elements
       for(unsigned i = shift_number + 1; i <= size; ++i)
-        value[i - shift_number] = value[i]; 
+        sparse_values[i - shift_number] = sparse_values[i]; 
 
       // remove tail elements
       for(unsigned i = size - shift_number + 1; i <= size; ++i)
-        value.erase(i); 
+        sparse_values.erase(i); 
     }
 
     return 0;
@@ -279,8 +592,28 @@ inline variable::variable<>(const std::string& name,
                             const std::map<unsigned, std::string>& v,
                             bool ro,
                             unsigned)
-    : name(name), value(v.begin(), v.end()), readonly(ro)
+    : name(name), layout(scalar_storage), scalar_set(false), dense_begin(0), dense_skip(0), readonly(ro)
+{
+  set_elements(v);
+}
+
+/// \brief the specialized constructor for contiguous arrays such as
+///        positional parameters
+/// \param name the variable name
+/// \param v the variable value
+/// \param ro whether the variable readonly
+/// \param index the index of the first element
+template <>
+inline variable::variable<>(const std::string& name,
+                            const std::vector<std::string>& v,
+                            bool ro,
+                            unsigned index)
+    : name(name), layout(scalar_storage), scalar_set(false), dense_begin(index), dense_skip(0), readonly(ro)
 {
+  if(v.empty())
+    return;
+  layout = dense_storage;
+  dense_values.assign(v.begin(), v.end());
 }
 
 #endif
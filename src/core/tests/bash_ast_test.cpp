@@ -22,10 +22,17 @@
 ///
 
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <string>
+#include <vector>
+#include <thread>
+
+#include <cstdlib>
 
 #include <gtest/gtest.h>
+#include <glob.h>
+#include <unistd.h>
 
 #include "core/bash_ast.h"
 #include "core/interpreter.h"
@@ -54,3 +61,156 @@ TEST(bash_ast, illegal_path)
 {
   EXPECT_THROW(bash_ast("not_exist"), libbash::parse_exception);
 }
+
+TEST(bash_ast, walk_twice)
+{
+  // The text of imaginary tokens is created while walking and kept by the
+  // tokens, so it must live as long as the AST. Run this under valgrind
+  // with make memcheck.
+  bash_ast ast(std::stringstream("x=abc\necho ${x::1}${x:1:1}"));
+  for(int i = 0; i != 2; ++i)
+  {
+    std::thread walk([&]() {
+      interpreter walker;
+      std::stringstream output;
+      walker.set_output_stream(&output);
+      ast.interpret_with(walker);
+      EXPECT_STREQ("ab\n", output.str().c_str());
+    });
+    walk.join();
+  }
+}
+
+TEST(bash_ast, ast_cache)
+{
+  char cache_dir[] = "/tmp/libbash_ast_cache_XXXXXX";
+  ASSERT_TRUE(mkdtemp(cache_dir));
+  bash_ast::set_cache_directory(cache_dir);
+
+  const std::string script(get_src_dir() + std::string("/scripts/var_expansion.bash"));
+  bash_ast parsed(script);
+  bash_ast loaded(script);
+  EXPECT_STREQ(parsed.get_string_tree().c_str(), loaded.get_string_tree().c_str());
+
+  glob_t cache_files;
+  ASSERT_EQ(0, glob((std::string(cache_dir) + "/*.ast").c_str(), 0, 0, &cache_files));
+  EXPECT_EQ(1u, cache_files.gl_pathc);
+
+  // A broken cache file is ignored
+  {
+    std::ofstream broken(cache_files.gl_pathv[0], std::ios::trunc);
+    broken << "broken";
+  }
+  bash_ast reparsed(script);
+  EXPECT_STREQ(parsed.get_string_tree().c_str(), reparsed.get_string_tree().c_str());
+
+  // Nodes that point outside of the script are rejected. The header is 72
+  // bytes, the script is padded to 8 bytes and each node is 40 bytes with
+  // its start and stop at offset 16.
+  {
+    std::fstream corrupted(cache_files.gl_pathv[0], std::ios::in | std::ios::out | std::ios::binary);
+    std::ifstream script_file(script.c_str(), std::ios::binary | std::ios::ate);
+    const std::streamoff nodes_begin = 72 + ((script_file.tellg() + std::streamoff(7)) & ~std::streamoff(7));
+    const int64_t span[2] = {0, int64_t(1) << 40};
+    for(std::streamoff node = 0; node != 16; ++node)
+    {
+      corrupted.seekp(nodes_begin + node * 40 + 16);
+      corrupted.write(reinterpret_cast<const char*>(span), sizeof(span));
+    }
+  }
+  bash_ast rejected(script);
+  EXPECT_STREQ(parsed.get_string_tree().c_str(), rejected.get_string_tree().c_str());
+
+  globfree(&cache_files);
+
+  const std::string sourced(get_src_dir() + std::string("/scripts/source_true.sh"));
+  bash_ast first_parse(sourced);
+  bash_ast cached(sourced);
+  interpreter walker;
+  cached.interpret_with(walker);
+  EXPECT_STREQ("hello", walker.resolve<std::string>("FOO001").c_str());
+  EXPECT_TRUE(walker.has_function("foo"));
+
+  bash_ast::set_cache_directory("");
+  ASSERT_EQ(0, glob((std::string(cache_dir) + "/*").c_str(), 0, 0, &cache_files));
+  for(size_t i = 0; i != cache_files.gl_pathc; ++i)
+    unlink(cache_files.gl_pathv[i]);
+  globfree(&cache_files);
+  rmdir(cache_dir);
+}
+
+namespace
+{
+  typedef std::map<std::string, std::vector<std::string>> variable_map;
+
+  void interpret_script(bash_ast& ast, std::string& output, variable_map& variables)
+  {
+    interpreter walker;
+    std::stringstream output_stream;
+    walker.set_output_stream(&output_stream);
+    walker.set_error_stream(&output_stream);
+    ast.interpret_with(walker);
+    output = output_stream.str();
+    for(auto iter = walker.begin(); iter != walker.end(); ++iter)
+      iter->second->get_all_values<std::string>(variables[iter->first]);
+  }
+}
+
+TEST(bash_ast, ast_cache_interpretation)
+{
+  char cache_dir[] = "/tmp/libbash_ast_cache_XXXXXX";
+  ASSERT_TRUE(mkdtemp(cache_dir));
+  bash_ast::set_cache_directory(cache_dir);
+
+  const char* scripts[] = {"var_expansion.bash", "compound_command.bash", "test_expr.bash"};
+  for(auto iter = std::begin(scripts); iter != std::end(scripts); ++iter)
+  {
+    const std::string script(get_src_dir() + std::string("/scripts/") + *iter);
+    std::string cold_output, warm_output;
+    variable_map cold_variables, warm_variables;
+
+    bash_ast cold(script);
+    interpret_script(cold, cold_output, cold_variables);
+    bash_ast warm(script);
+    interpret_script(warm, warm_output, warm_variables);
+
+    EXPECT_FALSE(cold_output.empty()) << *iter;
+    EXPECT_EQ(cold_output, warm_output) << *iter;
+    EXPECT_TRUE(cold_variables == warm_variables) << *iter;
+  }
+
+  bash_ast::set_cache_directory("");
+  glob_t cache_files;
+  ASSERT_EQ(0, glob((std::string(cache_dir) + "/*").c_str(), 0, 0, &cache_files));
+  EXPECT_EQ(3u, cache_files.gl_pathc);
+  for(size_t i = 0; i != cache_files.gl_pathc; ++i)
+    unlink(cache_files.gl_pathv[i]);
+  globfree(&cache_files);
+  rmdir(cache_dir);
+}
+
+TEST(bash_ast, lazy_function_bodies)
+{
+  char script_path[] = "/tmp/libbash_lazy_XXXXXX";
+  int fd = mkstemp(script_path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  {
+    std::ofstream script(script_path);
+    script << "foo() {\n  echo \"}\" ${bar:-}}\n}\nbroken() { if; }\nfoo";
+  }
+
+  bash_ast::set_lazy_function_bodies(true);
+  bash_ast ast((std::string(script_path)));
+  bash_ast::set_lazy_function_bodies(false);
+  unlink(script_path);
+
+  interpreter walker;
+  std::stringstream output;
+  walker.set_output_stream(&output);
+  ast.interpret_with(walker);
+  EXPECT_STREQ("} }\n", output.str().c_str());
+  EXPECT_TRUE(walker.has_function("broken"));
+  interpreter::local_scope current_scope(walker);
+  EXPECT_THROW(walker.call("broken", {}), libbash::parse_exception);
+}
@@ -157,6 +157,41 @@ TEST_F(file_test, binary_operator)
   EXPECT_THROW(internal::test_binary("efd", positive, negative, walker), libbash::illegal_argument_exception);
 }
 
+TEST_F(file_test, file_status_cache)
+{
+  file_status_cache cache;
+  EXPECT_TRUE(internal::test_unary('f', positive, &cache));
+  EXPECT_EQ(0u, cache.get_hits());
+  EXPECT_EQ(2u, cache.get_misses());
+  EXPECT_TRUE(internal::test_unary('e', positive, &cache));
+  EXPECT_TRUE(internal::test_unary('x', positive, &cache));
+  EXPECT_EQ(4u, cache.get_hits());
+  EXPECT_EQ(3u, cache.get_misses());
+  EXPECT_TRUE(internal::test_unary('L', test_link, &cache));
+  EXPECT_FALSE(internal::test_unary('e', "not_exist", &cache));
+  EXPECT_FALSE(internal::test_unary('e', "not_exist", &cache));
+  EXPECT_EQ(5u, cache.get_hits());
+  EXPECT_EQ(5u, cache.get_misses());
+
+  // The cached status is used even if the file changes
+  EXPECT_EQ(0, unlink(positive.c_str()));
+  EXPECT_TRUE(internal::test_unary('f', positive, &cache));
+  cache.invalidate(positive);
+  EXPECT_FALSE(internal::test_unary('f', positive, &cache));
+  EXPECT_NE(-1, creat(positive.c_str(), 0));
+
+  interpreter walker;
+  walker.set_file_status_cache(std::make_shared<file_status_cache>());
+  EXPECT_TRUE(internal::test_binary("ot", negative, positive, walker));
+  EXPECT_TRUE(internal::test_binary("ef", negative, negative, walker));
+  EXPECT_EQ(2u, walker.get_file_status_cache()->get_hits());
+  EXPECT_EQ(2u, walker.get_file_status_cache()->get_misses());
+  walker.invalidate_file_status(negative);
+  EXPECT_TRUE(internal::test_binary("ef", negative, negative, walker));
+  EXPECT_EQ(3u, walker.get_file_status_cache()->get_hits());
+  EXPECT_EQ(3u, walker.get_file_status_cache()->get_misses());
+}
+
 TEST(bash_condition, arithmetic_operator)
 {
   interpreter walker;
@@ -0,0 +1,75 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+///
+/// \file function_body_scanner_test.cpp
+/// \brief series of unit tests for the function body scanner
+///
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "core/function_body_scanner.h"
+
+namespace
+{
+  // return the text of the function body, empty if it can't be found
+  std::string scan(const std::string& script)
+  {
+    const char* end = find_function_body_end(script.c_str());
+    return end ? std::string(script.c_str(), end + 1) : "";
+  }
+}
+
+TEST(function_body_scanner, simple_body)
+{
+  EXPECT_STREQ("{ echo hi; }", scan("{ echo hi; }\nfoo").c_str());
+  EXPECT_STREQ("{\n  echo hi\n}", scan("{\n  echo hi\n}\nbar() { :; }").c_str());
+  EXPECT_STREQ("{ { a; }; b; }", scan("{ { a; }; b; } }").c_str());
+  EXPECT_STREQ("{ if true; then { a; }; fi; }", scan("{ if true; then { a; }; fi; }").c_str());
+  EXPECT_STREQ("{ { while a; do b; done } }", scan("{ { while a; do b; done } }").c_str());
+  EXPECT_STREQ("{ a | \\\n  { b; }; }", scan("{ a | \\\n  { b; }; }").c_str());
+}
+
+TEST(function_body_scanner, braces_in_words)
+{
+  EXPECT_STREQ("{ echo } {a,b} ${foo} ${bar#\\}} \"${baz:-}}\"; }",
+               scan("{ echo } {a,b} ${foo} ${bar#\\}} \"${baz:-}}\"; }").c_str());
+  EXPECT_STREQ("{ echo '}' \"}\" \\} $'\\'}' `echo }`; }",
+               scan("{ echo '}' \"}\" \\} $'\\'}' `echo }`; }").c_str());
+  EXPECT_STREQ("{ a=$(echo \"}\"; echo }); }", scan("{ a=$(echo \"}\"; echo }); }").c_str());
+}
+
+TEST(function_body_scanner, comments_and_here_documents)
+{
+  EXPECT_STREQ("{ # }\n  echo $# a#}\n}", scan("{ # }\n  echo $# a#}\n}").c_str());
+  EXPECT_STREQ("{\n  cat <<-EOF >file\n\tdon't }\n\tEOF\n  cat <<<'}'\n}",
+               scan("{\n  cat <<-EOF >file\n\tdon't }\n\tEOF\n  cat <<<'}'\n}").c_str());
+  EXPECT_STREQ("{ (( a << 1 )); }", scan("{ (( a << 1 )); }").c_str());
+}
+
+TEST(function_body_scanner, not_found)
+{
+  EXPECT_STREQ("", scan("( echo )").c_str());
+  EXPECT_STREQ("", scan("{echo; }").c_str());
+  EXPECT_STREQ("", scan("{ echo; ").c_str());
+  EXPECT_STREQ("", scan("{ echo '}; }").c_str());
+  EXPECT_STREQ("", scan("{ cat <<EOF\n}\n").c_str());
+}
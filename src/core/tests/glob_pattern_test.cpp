@@ -0,0 +1,156 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file glob_pattern_test.cpp
+/// \brief series of unit tests for compiled shell patterns
+///
+
+#include <gtest/gtest.h>
+
+#include "core/glob_pattern.h"
+
+namespace
+{
+  std::string literal(const std::string& text)
+  {
+    std::string source;
+    glob_pattern::append_literal(source, text);
+    return source;
+  }
+}
+
+TEST(glob_pattern, wildcards)
+{
+  glob_pattern pattern("*" + literal(".tar.") + "?z", true);
+  EXPECT_TRUE(pattern.match("foo.tar.gz"));
+  EXPECT_TRUE(pattern.match(".tar.xz"));
+  EXPECT_FALSE(pattern.match("foo.tar.bz2"));
+  EXPECT_FALSE(pattern.uses_extglob());
+}
+
+TEST(glob_pattern, escaped_literals)
+{
+  glob_pattern pattern(literal("a*?[b](c)|d\\"), true);
+  EXPECT_TRUE(pattern.match("a*?[b](c)|d\\"));
+  EXPECT_FALSE(pattern.match("abc"));
+}
+
+TEST(glob_pattern, brackets)
+{
+  std::string source;
+  glob_pattern::append_bracket(source, "[:digit:]a-c", false);
+  glob_pattern::append_bracket(source, "!x", true);
+  glob_pattern pattern(source, true);
+  EXPECT_TRUE(pattern.match("1y"));
+  EXPECT_TRUE(pattern.match("b#"));
+  EXPECT_FALSE(pattern.match("bx"));
+  EXPECT_FALSE(pattern.match("b!"));
+  EXPECT_FALSE(pattern.match("dy"));
+}
+
+TEST(glob_pattern, negated_caret)
+{
+  // [!^a] only negates once, the caret is a literal
+  std::string source;
+  glob_pattern::append_bracket(source, "^a", true);
+  glob_pattern pattern(source, true);
+  EXPECT_TRUE(pattern.match("b"));
+  EXPECT_FALSE(pattern.match("a"));
+  EXPECT_FALSE(pattern.match("^"));
+
+  source.clear();
+  glob_pattern::append_bracket(source, "^a", false);
+  glob_pattern literal_caret(source, true);
+  EXPECT_TRUE(literal_caret.match("^"));
+  EXPECT_FALSE(literal_caret.match("b"));
+  EXPECT_TRUE(glob_pattern("[^a]", true).match("b"));
+}
+
+TEST(glob_pattern, alternatives)
+{
+  glob_pattern pattern(literal("amd64") + "|" + literal("x86") + "*", true);
+  EXPECT_TRUE(pattern.match("amd64"));
+  EXPECT_TRUE(pattern.match("x86-fbsd"));
+  EXPECT_FALSE(pattern.match("arm"));
+}
+
+TEST(glob_pattern, extended)
+{
+  glob_pattern pattern("+(" + literal("ab") + "|" + literal("c") + ")" + literal("."), true);
+  EXPECT_TRUE(pattern.uses_extglob());
+  EXPECT_TRUE(pattern.match("abcab."));
+  EXPECT_FALSE(pattern.match("."));
+
+  glob_pattern none("!(" + literal("a") + "|" + literal("b") + "*)", true);
+  EXPECT_TRUE(none.match(""));
+  EXPECT_TRUE(none.match("ca"));
+  EXPECT_FALSE(none.match("a"));
+  EXPECT_FALSE(none.match("bc"));
+}
+
+TEST(glob_pattern, search)
+{
+  std::string::size_type begin, end;
+  std::string value = "foo.bar.baz";
+
+  ASSERT_TRUE(glob_pattern("*" + literal("."), true, glob_pattern::at_start).search(value, 0, begin, end));
+  EXPECT_EQ(0u, begin);
+  EXPECT_EQ(8u, end);
+  ASSERT_TRUE(glob_pattern("*" + literal("."), false, glob_pattern::at_start).search(value, 0, begin, end));
+  EXPECT_EQ(4u, end);
+
+  ASSERT_TRUE(glob_pattern(literal(".") + "*", true, glob_pattern::at_end).search(value, 0, begin, end));
+  EXPECT_EQ(3u, begin);
+  EXPECT_EQ(11u, end);
+  ASSERT_TRUE(glob_pattern(literal(".") + "*", false, glob_pattern::at_end).search(value, 0, begin, end));
+  EXPECT_EQ(7u, begin);
+
+  ASSERT_TRUE(glob_pattern(literal("ba") + "?", true).search(value, 5, begin, end));
+  EXPECT_EQ(8u, begin);
+  EXPECT_EQ(11u, end);
+  EXPECT_FALSE(glob_pattern(literal("qux"), true).search(value, 0, begin, end));
+
+  // the longest match is chosen whatever the order of the branches is
+  ASSERT_TRUE(glob_pattern("@(" + literal("a") + "|" + literal("ab") + ")", true).search("abc", 0, begin, end));
+  EXPECT_EQ(2u, end);
+}
+
+TEST(glob_pattern_set, first_matching_clause)
+{
+  glob_pattern_set patterns;
+  patterns.add(std::make_shared<glob_pattern>(literal("amd64") + "|" + literal("x86"), true));
+  patterns.add(std::shared_ptr<const glob_pattern>());
+  patterns.add(std::make_shared<glob_pattern>(literal("x86") + "*", true));
+  patterns.add(std::make_shared<glob_pattern>(literal("x86-fbsd") + "|" + literal("arm"), true));
+  patterns.add(std::make_shared<glob_pattern>("*", true));
+
+  EXPECT_TRUE(patterns.is_static(0));
+  EXPECT_FALSE(patterns.is_static(1));
+  EXPECT_FALSE(patterns.is_static(5));
+
+  EXPECT_EQ(0, patterns.find("x86"));
+  EXPECT_EQ(2, patterns.find("x86-fbsd"));
+  EXPECT_EQ(3, patterns.find("arm"));
+  EXPECT_EQ(4, patterns.find("ppc"));
+
+  glob_pattern_set literals;
+  literals.add(std::make_shared<glob_pattern>(literal("0") + "|" + literal("1"), true));
+  EXPECT_EQ(0, literals.find("1"));
+  EXPECT_EQ(-1, literals.find("2"));
+}
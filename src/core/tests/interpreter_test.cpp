@@ -21,6 +21,8 @@
 /// \brief series of unit tests for interpreter.
 ///
 
+#include <set>
+
 #include <gtest/gtest.h>
 
 #include "core/interpreter.h"
@@ -242,6 +244,26 @@ TEST(interpreter, word_split)
   EXPECT_EQ(2, splitted_values.size());
   EXPECT_STREQ("foo", splitted_values[0].c_str());
   EXPECT_STREQ("bar", splitted_values[1].c_str());
+
+  // The table of delimiters follows changes of IFS
+  splitted_values.clear();
+  walker.set_value<std::string>("IFS", ":");
+  walker.split_word("::foo bar:baz:", splitted_values);
+  EXPECT_EQ(2, splitted_values.size());
+  EXPECT_STREQ("foo bar", splitted_values[0].c_str());
+  EXPECT_STREQ("baz", splitted_values[1].c_str());
+
+  {
+    interpreter::local_scope temp_scope(walker);
+    walker.define_local("IFS", ",");
+    splitted_values.clear();
+    walker.split_word("a:b,c", splitted_values);
+    EXPECT_EQ(2, splitted_values.size());
+  }
+  splitted_values.clear();
+  walker.split_word("a:b,c", splitted_values);
+  EXPECT_EQ(2, splitted_values.size());
+  EXPECT_STREQ("b,c", splitted_values[1].c_str());
 }
 
 TEST(interpreter, bash_additional_option)
@@ -294,3 +316,107 @@ TEST(interpreter, legal_function_names)
   EXPECT_NO_THROW(walker.define_function("1abb", 0));
   EXPECT_NO_THROW(walker.define_function("a-b", 0));
 }
+
+TEST(interpreter, layered_globals)
+{
+  std::shared_ptr<interpreter> base(new interpreter);
+  base->define("shared", "base");
+  base->define("removed", "base");
+  base->define("array", "0", false, 0);
+  base->freeze();
+
+  interpreter walker(base);
+  EXPECT_EQ(base->size(), walker.size());
+  EXPECT_EQ(base->begin()->second, walker.begin()->second);
+
+  walker.set_value<std::string>("shared", "walker");
+  walker.set_value<std::string>("array", "1", 1);
+  walker.unset("removed");
+  walker.define("added", "walker");
+
+  EXPECT_STREQ("walker", walker.resolve<std::string>("shared").c_str());
+  EXPECT_STREQ("base", base->resolve<std::string>("shared").c_str());
+  EXPECT_STREQ("1", walker.resolve<std::string>("array", 1).c_str());
+  EXPECT_STREQ("", base->resolve<std::string>("array", 1).c_str());
+  EXPECT_TRUE(walker.is_unset("removed"));
+  EXPECT_FALSE(base->is_unset("removed"));
+  EXPECT_TRUE(base->is_unset("added"));
+  EXPECT_EQ(base->size(), walker.size());
+
+  std::set<std::string> names;
+  for(auto iter = walker.begin(); iter != walker.end(); ++iter)
+    EXPECT_TRUE(names.insert(iter->first).second);
+  EXPECT_EQ(1, names.count("added"));
+  EXPECT_EQ(0, names.count("removed"));
+}
+
+TEST(interpreter, nested_local_scopes)
+{
+  interpreter walker;
+  walker.define("var", "global");
+  {
+    interpreter::local_scope outer_scope(walker);
+    walker.define_local("var", "outer");
+    {
+      interpreter::local_scope inner_scope(walker);
+      EXPECT_STREQ("outer", walker.resolve<string>("var").c_str());
+      walker.define_local("var", "inner");
+      walker.define_local("var", "inner again");
+      EXPECT_STREQ("inner again", walker.resolve<string>("var").c_str());
+      walker.unset("var");
+      EXPECT_STREQ("outer", walker.resolve<string>("var").c_str());
+      walker.define_local("var", "inner");
+    }
+    EXPECT_STREQ("outer", walker.resolve<string>("var").c_str());
+  }
+  EXPECT_STREQ("global", walker.resolve<string>("var").c_str());
+}
+
+TEST(interpreter, local_scopes_by_symbol_id)
+{
+  interpreter walker;
+  interpreter::local_scope current_scope(walker);
+  // Looking up a name that is not defined doesn't intern it
+  EXPECT_STREQ("", walker.resolve<string>("interpreter_undefined_name").c_str());
+  walker.set_value<string>("interpreter_undefined_name", "global");
+  unsigned id;
+  EXPECT_FALSE(find_symbol_id("interpreter_undefined_name", id));
+
+  symbol_id var_id(get_symbol_id("interpreter_local_name"));
+  walker.define_local<string>("interpreter_local_name", "local", false, 0, var_id);
+  EXPECT_STREQ("local", walker.resolve<string>("interpreter_local_name").c_str());
+  EXPECT_STREQ("local", walker.resolve<string>("interpreter_local_name", 0, var_id).c_str());
+  walker.set_value<string>("interpreter_local_name", "changed", 0, var_id);
+  EXPECT_STREQ("changed", walker.resolve<string>("interpreter_local_name").c_str());
+}
+
+TEST(interpreter, match_regex)
+{
+  interpreter walker;
+  std::vector<string> groups;
+  // Like bash, =~ searches for the regex anywhere in the value
+  EXPECT_TRUE(walker.match_regex("abc", "b"));
+  EXPECT_TRUE(walker.match_regex("foo-1.2x", "([0-9])\\.([0-9])"));
+  EXPECT_TRUE(walker.resolve_array("BASH_REMATCH", groups));
+  ASSERT_EQ(3u, groups.size());
+  EXPECT_STREQ("1.2", groups[0].c_str());
+  EXPECT_STREQ("2", groups[2].c_str());
+
+  EXPECT_FALSE(walker.match_regex("abc", "^b"));
+  groups.clear();
+  walker.resolve_array("BASH_REMATCH", groups);
+  EXPECT_TRUE(groups.empty());
+}
+
+TEST(interpreter, match_regex_local)
+{
+  interpreter walker;
+  walker.define("BASH_REMATCH", std::string("global"));
+  {
+    interpreter::local_scope current_scope(walker);
+    walker.define_local("BASH_REMATCH", std::string());
+    EXPECT_TRUE(walker.match_regex("abc", "b"));
+    EXPECT_STREQ("b", walker.resolve<string>("BASH_REMATCH").c_str());
+  }
+  EXPECT_STREQ("global", walker.resolve<string>("BASH_REMATCH").c_str());
+}
@@ -0,0 +1,70 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file lru_cache_test.cpp
+/// \brief series of unit tests for lru_cache.
+///
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "core/lru_cache.hpp"
+
+TEST(lru_cache, get_put)
+{
+  lru_cache<std::string, int> cache(2);
+  EXPECT_EQ(0, cache.get("foo"));
+
+  cache.put("foo", 1);
+  cache.put("bar", 2);
+  ASSERT_TRUE(cache.get("foo"));
+  EXPECT_EQ(1, *cache.get("foo"));
+  EXPECT_EQ(2, *cache.get("bar"));
+
+  cache.put("foo", 3);
+  EXPECT_EQ(3, *cache.get("foo"));
+  EXPECT_EQ(2u, cache.size());
+}
+
+TEST(lru_cache, drop_least_recently_used)
+{
+  lru_cache<std::string, int> cache(2);
+  cache.put("foo", 1);
+  cache.put("bar", 2);
+  // foo becomes the most recently used one
+  cache.get("foo");
+  cache.put("baz", 3);
+
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_TRUE(cache.get("foo"));
+  EXPECT_FALSE(cache.get("bar"));
+  EXPECT_TRUE(cache.get("baz"));
+
+  cache.clear();
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_FALSE(cache.get("foo"));
+}
+
+TEST(lru_cache, zero_capacity)
+{
+  lru_cache<std::string, int> cache(0);
+  cache.put("foo", 1);
+  EXPECT_FALSE(cache.get("foo"));
+}
@@ -0,0 +1,69 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file symbol_ids_test.cpp
+/// \brief series of unit tests for interned variable names
+///
+
+#include <thread>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+#include <gtest/gtest.h>
+
+#include "core/symbol_ids.h"
+
+TEST(symbol_ids, same_name_same_id)
+{
+  unsigned foo = get_symbol_id("symbol_ids_foo");
+  unsigned bar = get_symbol_id("symbol_ids_bar");
+
+  EXPECT_NE(foo, bar);
+  EXPECT_EQ(foo, get_symbol_id("symbol_ids_foo"));
+  EXPECT_EQ(bar, get_symbol_id(std::string("symbol_ids_bar")));
+}
+
+TEST(symbol_ids, shared_by_threads)
+{
+  unsigned foo = get_symbol_id("symbol_ids_foo");
+  std::vector<unsigned> results(8);
+  std::vector<std::thread> threads;
+
+  for(unsigned i = 0; i != results.size(); ++i)
+    threads.push_back(std::thread([&, i]() {
+      get_symbol_id("symbol_ids_thread" + boost::lexical_cast<std::string>(i));
+      results[i] = get_symbol_id("symbol_ids_foo");
+    }));
+  for(auto iter = threads.begin(); iter != threads.end(); ++iter)
+    iter->join();
+
+  for(auto iter = results.begin(); iter != results.end(); ++iter)
+    EXPECT_EQ(foo, *iter);
+}
+
+TEST(symbol_ids, find_without_interning)
+{
+  unsigned id;
+  EXPECT_FALSE(find_symbol_id("symbol_ids_not_interned", id));
+  EXPECT_FALSE(find_symbol_id("symbol_ids_not_interned", id));
+
+  unsigned baz = get_symbol_id("symbol_ids_baz");
+  ASSERT_TRUE(find_symbol_id("symbol_ids_baz", id));
+  EXPECT_EQ(baz, id);
+}
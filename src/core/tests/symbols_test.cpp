@@ -21,6 +21,7 @@
 /// \brief series of unit tests for symbols and symbol table.
 ///
 
+#include <boost/lexical_cast.hpp>
 #include <gtest/gtest.h>
 
 #include "core/symbols.hpp"
@@ -150,3 +151,119 @@ TEST(symbol_test, get_length)
   EXPECT_EQ(5, array.get_length(2));
   EXPECT_EQ(3, array.get_array_length());
 }
+
+TEST(symbol_test, array_layouts)
+{
+  variable var("foo", "0");
+  var.set_value("1", 1);
+  var.set_value("2", 2);
+  EXPECT_EQ(3, var.get_array_length());
+  EXPECT_EQ(2, var.get_max_index());
+
+  // leave a hole in the array
+  var.unset_value(1);
+  EXPECT_TRUE(var.is_unset(1));
+  EXPECT_EQ(2, var.get_array_length());
+  EXPECT_EQ(2, var.get_max_index());
+  var.set_value("10", 10);
+  EXPECT_EQ(10, var.get_max_index());
+
+  vector<string> values;
+  var.get_all_values(values);
+  EXPECT_EQ((vector<string>{"0", "2", "10"}), values);
+
+  variable empty("empty", "");
+  empty.unset_value(0);
+  EXPECT_EQ(0, empty.get_array_length());
+  empty.set_value("5", 5);
+  EXPECT_TRUE(empty.is_unset(0));
+  EXPECT_STREQ("5", empty.get_value<string>(5).c_str());
+}
+
+TEST(symbol_test, shift)
+{
+  map<unsigned, string> values = {{1, "1"}, {2, "2"}, {3, "3"}};
+  variable args("*", values);
+  EXPECT_EQ(0, args.shift(1));
+  EXPECT_STREQ("2", args.get_value<string>(1).c_str());
+  EXPECT_STREQ("3", args.get_value<string>(2).c_str());
+  EXPECT_TRUE(args.is_unset(3));
+  EXPECT_EQ(1, args.shift(3));
+  EXPECT_EQ(0, args.shift(2));
+  EXPECT_EQ(0, args.get_array_length());
+}
+
+TEST(symbol_test, dual_value)
+{
+  EXPECT_EQ(-123, dual_value("-123").get<long>());
+  EXPECT_EQ(123, dual_value("+123").get<long>());
+  EXPECT_EQ(8, dual_value("008").get<long>());
+  EXPECT_EQ(0, dual_value("").get<long>());
+  EXPECT_EQ(0, dual_value("-").get<long>());
+  EXPECT_EQ(0, dual_value(" 1").get<long>());
+  EXPECT_EQ(0, dual_value("1a").get<long>());
+  EXPECT_EQ(0, dual_value("99999999999999999999").get<long>());
+  EXPECT_EQ(numeric_limits<long>::min(),
+            dual_value(dual_value(numeric_limits<long>::min()).get<string>()).get<long>());
+
+  EXPECT_STREQ("0", dual_value(0).get<string>().c_str());
+  EXPECT_STREQ("-42", dual_value(-42l).get<string>().c_str());
+
+  // both representations are kept
+  dual_value value("12");
+  EXPECT_EQ(12, value.get<long>());
+  EXPECT_STREQ("12", value.get<string>().c_str());
+  EXPECT_STREQ("007", dual_value("007").get<string>().c_str());
+}
+
+TEST(symbol_test, shift_contiguous)
+{
+  vector<string> values;
+  for(int i = 1; i <= 100; ++i)
+    values.push_back(boost::lexical_cast<string>(i));
+  variable args("*", values, false, 1);
+  EXPECT_EQ(100, args.get_array_length());
+  EXPECT_STREQ("1", args.get_value<string>(1).c_str());
+
+  for(int i = 1; i < 100; ++i)
+  {
+    EXPECT_EQ(0, args.shift(1));
+    EXPECT_STREQ(boost::lexical_cast<string>(i + 1).c_str(), args.get_value<string>(1).c_str());
+    EXPECT_EQ(100 - i, args.get_max_index());
+  }
+  args.set_value("new", 2);
+  EXPECT_STREQ("new", args.get_value<string>(2).c_str());
+  args.unset_value(1);
+  EXPECT_TRUE(args.is_unset(1));
+  EXPECT_EQ(1, args.get_array_length());
+
+  variable empty("*", vector<string>(), false, 1);
+  EXPECT_EQ(0, empty.get_array_length());
+}
+
+TEST(symbol_test, for_each_string)
+{
+  map<unsigned, string> values = {{0, "1"}, {3, "2"}, {5, "3"}};
+  variable array("foo", values);
+  array.set_value(4l, 4);
+
+  string joined;
+  array.for_each_string([&](const string& value) { joined += value; });
+  EXPECT_STREQ("1243", joined.c_str());
+}
+
+TEST(symbol_test, length_without_conversion)
+{
+  EXPECT_EQ(1, dual_value(0).get_length());
+  EXPECT_EQ(3, dual_value(-42).get_length());
+  EXPECT_EQ(20, dual_value(numeric_limits<long>::min()).get_length());
+  EXPECT_EQ(19, dual_value(numeric_limits<long>::max()).get_length());
+  EXPECT_FALSE(dual_value(0).is_empty());
+  EXPECT_TRUE(dual_value("").is_empty());
+
+  variable var("foo", 12345);
+  EXPECT_EQ(5, var.get_length());
+  EXPECT_STREQ("12345", var.get_string().c_str());
+  EXPECT_STREQ("", var.get_string(1).c_str());
+  EXPECT_TRUE(var.is_null(1));
+}
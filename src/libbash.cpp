@@ -29,6 +29,14 @@
 
 #include "core/interpreter.h"
 #include "core/bash_ast.h"
+#include "core/bash_condition.h"
+
+namespace
+{
+  /// \brief the file status cache shared by all the interpreters, null
+  ///        when it is disabled
+  std::shared_ptr<file_status_cache> shared_file_statuses;
+}
 
 namespace internal
 {
@@ -61,6 +69,7 @@ namespace libbash
                 std::vector<std::string>& functions)
   {
     interpreter walker;
+    walker.set_file_status_cache(shared_file_statuses);
     return internal::interpret(walker, target_path, variables, functions);
   }
 
@@ -69,12 +78,47 @@ namespace libbash
                 std::unordered_map<std::string, std::vector<std::string>>& variables,
                 std::vector<std::string>& functions)
   {
-    interpreter walker;
+    return snapshot(preload_path).interpret(target_path, variables, functions);
+  }
 
-    // Preloading
-    bash_ast preload_ast(preload_path);
-    preload_ast.interpret_with(walker);
+  snapshot::snapshot(const std::string& preload_path)
+  {
+    // Functions defined by the preload script refer to its AST
+    preload_ast.reset(new bash_ast(preload_path));
+    std::shared_ptr<interpreter> walker(new interpreter);
+    walker->set_file_status_cache(shared_file_statuses);
+    preload_ast->interpret_with(*walker);
+    // Let the interpreters created from the snapshot share the variables
+    walker->freeze();
+    base = walker;
+  }
 
+  int snapshot::interpret(const std::string& target_path,
+                          std::unordered_map<std::string, std::vector<std::string>>& variables,
+                          std::vector<std::string>& functions) const
+  {
+    interpreter walker(base);
     return internal::interpret(walker, target_path, variables, functions);
   }
+
+  void set_ast_cache_directory(const std::string& directory)
+  {
+    bash_ast::set_cache_directory(directory);
+  }
+
+  void set_lazy_function_bodies(bool lazy)
+  {
+    bash_ast::set_lazy_function_bodies(lazy);
+  }
+
+  void set_file_status_cache(bool enabled)
+  {
+    shared_file_statuses.reset(enabled ? new file_status_cache : 0);
+  }
+
+  void get_file_status_cache_statistics(unsigned long& hits, unsigned long& misses)
+  {
+    hits = shared_file_statuses ? shared_file_statuses->get_hits() : 0;
+    misses = shared_file_statuses ? shared_file_statuses->get_misses() : 0;
+  }
 }
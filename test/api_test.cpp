@@ -21,7 +21,11 @@
 /// \brief series of unit tests for the public interface
 ///
 
+#include <cstdlib>
+#include <fstream>
+
 #include <gtest/gtest.h>
+#include <unistd.h>
 
 #include "libbash.h"
 #include "test.h"
@@ -83,3 +87,30 @@ TEST(libbashapi, preload)
                                   functions),
                libbash::parse_exception);
 }
+
+TEST(libbashapi, snapshot)
+{
+  char target_path[] = "/tmp/libbash_snapshot_XXXXXX";
+  int fd = mkstemp(target_path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  {
+    std::ofstream target(target_path);
+    target << "FOO001=\"changed $FOO001\"\nfoo() { :; }\nbar() { :; }";
+  }
+
+  libbash::snapshot preloaded(get_src_dir() + std::string("/scripts/source_true.sh"));
+  for(int i = 0; i != 2; ++i)
+  {
+    std::unordered_map<std::string, std::vector<std::string>> variables;
+    std::vector<std::string> functions;
+    EXPECT_EQ(0, preloaded.interpret(target_path, variables, functions));
+    // Every clone starts from the preloaded state
+    EXPECT_STREQ("changed hello", variables["FOO001"][0].c_str());
+    EXPECT_EQ(2u, functions.size());
+  }
+  unlink(target_path);
+
+  EXPECT_THROW(libbash::snapshot(get_src_dir() + std::string("/scripts/illegal_script.sh")),
+               libbash::parse_exception);
+}
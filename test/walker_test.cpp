@@ -91,6 +91,34 @@ TEST(extglob, used_when_disabled)
   }
 }
 
+TEST(extglob, cached_when_disabled)
+{
+  interpreter walker;
+
+  std::string script = "abc=a\ndef=${abc/?([a-z])/b}";
+  std::istringstream input(script);
+  bash_ast ast(input);
+  walker.set_additional_option("extglob", true);
+  ast.interpret_with(walker);
+  EXPECT_STREQ("b", walker.resolve<std::string>("def").c_str());
+
+  // The compiled pattern is cached in the AST
+  walker.set_additional_option("extglob", false);
+  EXPECT_THROW(ast.interpret_with(walker), libbash::unsupported_exception);
+}
+
+TEST(case_clause, not_compiled_after_match)
+{
+  interpreter walker;
+
+  // An unknown character class can't be compiled
+  std::string script = "for i in 1 2; do case a in a) x=$i;; [[:foo:]]) x=0;; esac; done";
+  std::istringstream input(script);
+  bash_ast ast(input);
+  ast.interpret_with(walker);
+  EXPECT_STREQ("2", walker.resolve<std::string>("x").c_str());
+}
+
 TEST(brace_expansion, not_in_raw_string)
 {
   interpreter walker;
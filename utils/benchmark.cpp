@@ -0,0 +1,255 @@
+/*
+   Please use git log for copyright holder and year information
+
+   This file is part of libbash.
+
+   libbash is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   libbash is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with libbash.  If not, see <http://www.gnu.org/licenses/>.
+*/
+///
+/// \file benchmark.cpp
+/// \brief micro benchmarks for the hot paths of the interpreter
+///
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glob.h>
+
+#include "core/bash_ast.h"
+#include "core/interpreter.h"
+#include "test.h"
+
+namespace
+{
+  typedef std::function<void()> benchmark_body;
+
+  /// \brief run the body the given times and print the time per iteration
+  void measure(const std::string& name, unsigned iterations, benchmark_body body)
+  {
+    // warm up caches
+    body();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(unsigned i = 0; i != iterations; ++i)
+      body();
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    std::cout << std::left << std::setw(40) << name
+              << std::right << std::setw(12) << nanoseconds / iterations << " ns/iteration" << std::endl;
+  }
+
+  void arithmetic()
+  {
+    interpreter walker;
+    walker.define("i", 0);
+    const std::string expression("i++ + 2 * (i - 1)");
+
+    measure("arithmetic, parsed on every call", 10000, [&]() {
+      bash_ast ast(std::stringstream(expression), &bash_ast::parser_arithmetics);
+      ast.interpret_with(walker, &bash_ast::walker_arithmetics);
+    });
+    measure("arithmetic, eval_arithmetic", 10000, [&]() {
+      walker.eval_arithmetic(expression);
+    });
+
+    bash_ast loop(std::stringstream("for (( i = 0; i < 1000; i++ )); do let \"j = i * 2\"; done"));
+    measure("let inside C-style for (1000 rounds)", 10, [&]() {
+      loop.interpret_with(walker);
+    });
+  }
+
+  void value_conversion()
+  {
+    interpreter walker;
+    std::stringstream output;
+    walker.set_output_stream(&output);
+
+    // Stored as integers and read as strings, then the other way round
+    bash_ast loop(std::stringstream(
+      "for (( i = 0; i < 1000; i++ )); do j=\"$i\"; (( k = j * 2 + i )); l=\"$k$j\"; done"));
+    measure("integer/string round trips (1000 rounds)", 10, [&]() {
+      loop.interpret_with(walker);
+    });
+
+    bash_ast script(get_src_dir() + "/scripts/binary_arithmetic.bash");
+    measure("interpret binary_arithmetic.bash", 100, [&]() {
+      output.str("");
+      script.interpret_with(walker);
+    });
+  }
+
+  void positional_parameters()
+  {
+    // Each shift should take constant time
+    for(unsigned count = 100; count <= 10000; count *= 10)
+    {
+      interpreter walker;
+      std::vector<std::string> arguments;
+      for(unsigned i = 0; i != count; ++i)
+        arguments.push_back("--option");
+      bash_ast loop(std::stringstream("while [[ $# -gt 0 ]]; do shift; done"));
+
+      std::stringstream name;
+      name << "shift through " << count << " arguments";
+      measure(name.str(), 10, [&]() {
+        walker.define_positional_arguments(arguments.begin(), arguments.end());
+        loop.interpret_with(walker);
+      });
+    }
+  }
+
+  void pattern_matching()
+  {
+    interpreter walker;
+    std::stringstream output;
+    walker.set_output_stream(&output);
+
+    // ${value%pat} should be linear in the length of the value
+    for(unsigned length = 100; length <= 100000; length *= 10)
+    {
+      walker.define("value", std::string(length, 'a') + ".tar.gz");
+      bash_ast ast(std::stringstream("echo ${value%.*} ${value%%.*} ${value#*a} ${value//a/b}"));
+
+      std::stringstream name;
+      name << "pattern expansions, " << length << " characters";
+      measure(name.str(), 10, [&]() {
+        output.str("");
+        ast.interpret_with(walker);
+      });
+    }
+
+    walker.set_additional_option("extglob", true);
+    bash_ast loop(std::stringstream(
+      "for (( i = 0; i < 1000; i++ )); do case \"x86-$i\" in amd64|arm*) ;; x86-+([0-9])) ;; esac; done"));
+    measure("case with static patterns (1000 rounds)", 10, [&]() {
+      loop.interpret_with(walker);
+    });
+  }
+
+  void function_definition()
+  {
+    // Defining a function should not depend on the size of its body
+    for(unsigned lines = 10; lines <= 10000; lines *= 10)
+    {
+      std::stringstream script;
+      script << "foo() {\n";
+      for(unsigned i = 0; i != lines; ++i)
+        script << "  if [[ -n $bar ]]; then echo \"${bar:-baz}\"; fi\n";
+      script << "}";
+
+      interpreter walker;
+      bash_ast ast(script);
+      std::stringstream name;
+      name << "define function, " << lines << " lines";
+      measure(name.str(), 1000, [&]() { ast.interpret_with(walker); });
+    }
+
+    // Set ECLASS_DIR to use real eclasses such as /usr/portage/eclass
+    std::string eclass_dir(getenv("ECLASS_DIR") ? getenv("ECLASS_DIR") : get_src_dir() + "/scripts");
+    glob_t eclasses;
+    if(glob((eclass_dir + "/*.eclass").c_str(), 0, 0, &eclasses) != 0)
+      return;
+
+    for(size_t i = 0; i != eclasses.gl_pathc; ++i)
+    {
+      std::string path(eclasses.gl_pathv[i]);
+      try
+      {
+        interpreter walker;
+        bash_ast ast(path);
+        measure("interpret " + path, 100, [&]() { ast.interpret_with(walker); });
+      }
+      catch(libbash::interpreter_exception& e)
+      {
+        std::cerr << path << ": " << e.what() << std::endl;
+      }
+    }
+    globfree(&eclasses);
+  }
+
+  void thread_scaling()
+  {
+    // The time per iteration should stay flat until we run out of cores
+    bash_ast ast(std::stringstream(
+      "for (( i = 0; i < 100; i++ )); do foo=\"bar $i\"; baz=${foo/bar/qux}; [[ -n $baz ]] && echo \"${baz:1:2}\"; done"));
+
+    for(unsigned thread_count = 1; thread_count <= 16; thread_count *= 2)
+    {
+      std::stringstream name;
+      name << "interpret in " << thread_count << " threads";
+      measure(name.str(), 20, [&]() {
+        std::vector<std::thread> threads;
+        for(unsigned i = 0; i != thread_count; ++i)
+          threads.push_back(std::thread([&]() {
+            std::stringstream output;
+            interpreter walker;
+            walker.set_output_stream(&output);
+            ast.interpret_with(walker);
+          }));
+        for(auto iter = threads.begin(); iter != threads.end(); ++iter)
+          iter->join();
+      });
+    }
+  }
+
+  const std::map<std::string, std::function<void()>> benchmarks = {
+    {"arithmetic", &arithmetic},
+    {"function_definition", &function_definition},
+    {"pattern_matching", &pattern_matching},
+    {"positional_parameters", &positional_parameters},
+    {"thread_scaling", &thread_scaling},
+    {"value_conversion", &value_conversion}
+  };
+}
+
+int main(int argc, char** argv)
+{
+  try
+  {
+    if(argc == 1)
+    {
+      for(auto iter = benchmarks.begin(); iter != benchmarks.end(); ++iter)
+        iter->second();
+      return EXIT_SUCCESS;
+    }
+
+    for(int i = 1; i != argc; ++i)
+    {
+      auto iter = benchmarks.find(argv[i]);
+      if(iter == benchmarks.end())
+      {
+        std::cerr << "Unknown benchmark: " << argv[i] << std::endl;
+        return EXIT_FAILURE;
+      }
+      iter->second();
+    }
+  }
+  catch(libbash::interpreter_exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
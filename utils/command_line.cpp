@@ -48,7 +48,11 @@ CommandLine::CommandLine() :
     a_repository_name(&general_args, "repository-name", 'n',
             "Use the specified name for the repository (default: gentoo)"),
     a_report_file(&general_args, "report-file", 'r',
-            "Write report to the specified file, rather than stdout")
+            "Write report to the specified file, rather than stdout"),
+    a_lazy_function_bodies(&general_args, "lazy-function-bodies", '\0',
+            "Only parse function bodies when the functions are called", false),
+    a_cache_file_status(&general_args, "cache-file-status", '\0',
+            "Cache the results of file tests across all the ebuilds", false)
 {
     add_usage_line("--generate-cache [ at least one of --repository-dir /dir or --output-dir /dir ]");
 
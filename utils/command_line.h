@@ -56,6 +56,8 @@ class CommandLine :
         paludis::args::StringArg a_output_directory;
         paludis::args::StringArg a_repository_name;
         paludis::args::StringArg a_report_file;
+        paludis::args::SwitchArg a_lazy_function_bodies;
+        paludis::args::SwitchArg a_cache_file_status;
 };
 
 #endif
@@ -72,6 +72,8 @@ void worker(const std::shared_ptr<PackageIDSequence> &ids, const std::string &re
 {
   unsigned total(0);
   CategoryNamePart old_cat("OLDCAT");
+  // Every ebuild starts from the state after interpreting isolated-functions.sh
+  const libbash::snapshot preloaded(get_src_dir() + "/utils/isolated-functions.sh");
   #pragma omp parallel
   {
     #pragma omp single nowait
@@ -110,7 +112,7 @@ void worker(const std::shared_ptr<PackageIDSequence> &ids, const std::string &re
                                 variables["PVR"][0] + ".ebuild");
         try
         {
-          libbash::interpret(ebuild_path, get_src_dir() + "/utils/isolated-functions.sh", variables, functions);
+          preloaded.interpret(ebuild_path, variables, functions);
 
           std::string output_path(CommandLine::get_instance()->a_output_directory.argument() + "/" +
                                   variables["CATEGORY"][0] + "/" +
@@ -178,6 +180,12 @@ int main(int argc, char** argv)
         return EXIT_SUCCESS;
     }
 
+    if (CommandLine::get_instance()->a_lazy_function_bodies.specified())
+        libbash::set_lazy_function_bodies(true);
+
+    if (CommandLine::get_instance()->a_cache_file_status.specified())
+        libbash::set_file_status_cache(true);
+
     if (! CommandLine::get_instance()->a_output_directory.specified())
         CommandLine::get_instance()->a_output_directory.set_argument(stringify(FSPath::cwd()));
 